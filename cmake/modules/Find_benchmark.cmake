@@ -0,0 +1,27 @@
+set(benchmark_NAME "benchmark")
+
+# Google Benchmark for cg_bench: an installed package (libbenchmark-dev,
+# brew's google-benchmark, or -Dbenchmark_DIR=...), otherwise downloaded at
+# configure time
+find_package(benchmark QUIET CONFIG)
+
+option(CG_FETCH_BENCHMARK "Download Google Benchmark when it isn't installed" ON)
+if (NOT benchmark_FOUND AND CG_FETCH_BENCHMARK)
+  include(FetchContent)
+  set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+  set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+  set(BENCHMARK_ENABLE_WERROR OFF CACHE BOOL "" FORCE)
+  FetchContent_Declare(
+    benchmark
+    GIT_REPOSITORY https://github.com/google/benchmark.git
+    GIT_TAG v1.9.1
+    GIT_SHALLOW TRUE)
+  FetchContent_MakeAvailable(benchmark)
+  set(benchmark_FOUND TRUE)
+endif()
+
+if(benchmark_FOUND)
+  set(benchmark_LIBRARIES benchmark::benchmark)
+else()
+  message(STATUS "Could not find Google Benchmark, cg_bench is not built. Install it or turn CG_FETCH_BENCHMARK on.")
+endif()
@@ -0,0 +1,38 @@
+set(egl_NAME "egl")
+
+find_path(
+  egl_INCLUDE_DIR
+
+  NAMES "EGL/egl.h"
+
+  PATHS
+  "/usr/include"
+  "/usr/local/include"
+
+  NO_DEFAULT_PATH
+)
+
+find_library(
+  egl_LIBRARY
+
+  NAMES EGL
+
+  PATHS
+  "/usr/local/lib"
+  "/usr/lib"
+  "/usr/lib/x86_64-linux-gnu"
+  "/usr/lib/aarch64-linux-gnu"
+
+  NO_DEFAULT_PATH
+)
+
+if(egl_INCLUDE_DIR AND egl_LIBRARY)
+  set(egl_FOUND TRUE)
+  set(egl_INCLUDE_DIRS ${egl_INCLUDE_DIR})
+  set(egl_LIBRARIES ${egl_LIBRARY})
+else()
+  set(egl_FOUND FALSE)
+  message(STATUS "Could not find EGL, demos are built without --headless.")
+endif()
+
+mark_as_advanced(egl_INCLUDE_DIR egl_LIBRARY)
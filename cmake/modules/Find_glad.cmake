@@ -1,4 +1,56 @@
 set(glad_NAME "glad")
 
-set(glad_SOURCES ${PROJECT_SOURCE_DIR}/thirdparty/glad/src/glad.c)
-set(glad_INCLUDE_DIRS ${PROJECT_SOURCE_DIR}/thirdparty/glad/include)
+set(glad_DIR ${PROJECT_SOURCE_DIR}/thirdparty/glad)
+set(glad_SOURCES ${glad_DIR}/src/glad.c)
+set(glad_INCLUDE_DIRS ${glad_DIR}/include)
+
+# a loader cut down to the GL core profile and the extensions the demos use,
+# see thirdparty/glad/trim_glad.py; OFF builds the full generated glad.c
+option(CG_TRIMMED_GLAD "Build a glad loader trimmed to CG_GLAD_API core and CG_GLAD_EXTENSIONS" ON)
+set(CG_GLAD_API "3.3" CACHE STRING "GL core profile version the trimmed loader keeps")
+set(CG_GLAD_EXTENSIONS
+  GL_KHR_debug
+  GL_ARB_timer_query
+  GL_ARB_texture_storage
+  GL_ARB_buffer_storage
+  GL_ARB_draw_indirect
+  GL_ARB_multi_draw_indirect
+  CACHE STRING "Extensions the trimmed loader resolves when the context has them")
+
+if (CG_TRIMMED_GLAD)
+  find_package(Python3 COMPONENTS Interpreter)
+  if (NOT Python3_Interpreter_FOUND)
+    message(STATUS "Python 3 not found, building the full glad loader.")
+  else()
+    # entry points called in learn_opengl are loaded up front, the rest of the
+    # profile on first use; regenerated when the sources change
+    file(GLOB_RECURSE glad_SCANNED CONFIGURE_DEPENDS
+      ${PROJECT_SOURCE_DIR}/learn_opengl/*.h ${PROJECT_SOURCE_DIR}/learn_opengl/*.cpp)
+    list(JOIN CG_GLAD_EXTENSIONS "," glad_EXTENSION_LIST)
+    set(glad_TRIMMED ${CMAKE_BINARY_DIR}/glad/glad_trimmed.c)
+    add_custom_command(
+      OUTPUT ${glad_TRIMMED}
+      COMMAND Python3::Interpreter ${glad_DIR}/trim_glad.py
+        --api ${CG_GLAD_API} --extensions ${glad_EXTENSION_LIST}
+        --scan ${PROJECT_SOURCE_DIR}/learn_opengl --out ${glad_TRIMMED}
+      DEPENDS
+        ${glad_DIR}/trim_glad.py ${glad_DIR}/gl_core_profile.txt
+        ${glad_DIR}/src/glad.c ${glad_DIR}/include/glad/glad.h ${glad_SCANNED}
+      COMMENT "Trimming the glad loader to GL ${CG_GLAD_API} core"
+      VERBATIM)
+    set(glad_SOURCES ${glad_TRIMMED})
+  endif()
+endif()
+
+# built once for all demos, so the generated loader has a single consumer and
+# parallel builds don't race to regenerate it
+if (NOT TARGET glad)
+  add_library(glad STATIC ${glad_SOURCES})
+  target_include_directories(glad PUBLIC ${glad_INCLUDE_DIRS})
+  target_link_libraries(glad PUBLIC ${CMAKE_DL_LIBS})
+  # nothing unwinds through the loader, its unwind tables would add 60% to it
+  if (glad_TRIMMED AND CMAKE_C_COMPILER_ID MATCHES "GNU|Clang")
+    target_compile_options(glad PRIVATE -fno-asynchronous-unwind-tables)
+  endif()
+endif()
+set(glad_LIBRARIES glad)
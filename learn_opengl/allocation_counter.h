@@ -0,0 +1,46 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// heap allocations made through operator new (std::vector, std::deque,
+// std::function, ...) since the program started; malloc() calls of C code
+// and of most drivers are not seen
+//
+// The counting operator new replaces the global one in the executable that
+// defines ALLOCATION_COUNTER_IMPLEMENTATION before including this header,
+// like stb_image.h. Without it the count stays 0.
+inline std::atomic<size_t> &allocation_count() {
+  static std::atomic<size_t> count(0);
+  return count;
+}
+
+#ifdef ALLOCATION_COUNTER_IMPLEMENTATION
+
+// kept out of line: once inlined, GCC pairs the malloc() inside operator new
+// with the caller's delete and warns about mismatched new/delete at -O1 and up
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ALLOCATION_COUNTER_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_COUNTER_NOINLINE __attribute__((noinline))
+#endif
+
+ALLOCATION_COUNTER_NOINLINE void *operator new(size_t size) {
+  allocation_count().fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+
+ALLOCATION_COUNTER_NOINLINE void *operator new[](size_t size) { return operator new(size); }
+ALLOCATION_COUNTER_NOINLINE void operator delete(void *memory) noexcept { free(memory); }
+ALLOCATION_COUNTER_NOINLINE void operator delete[](void *memory) noexcept { free(memory); }
+ALLOCATION_COUNTER_NOINLINE void operator delete(void *memory, size_t) noexcept { free(memory); }
+ALLOCATION_COUNTER_NOINLINE void operator delete[](void *memory, size_t) noexcept { free(memory); }
+
+#endif // ALLOCATION_COUNTER_IMPLEMENTATION
+
+#endif // ALLOCATION_COUNTER_H
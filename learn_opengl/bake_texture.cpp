@@ -0,0 +1,49 @@
+// bake an image into the raw .cgtex container understood by load_raw_texture,
+// or with --virtual into the paged .cgvt container streamed by VirtualTexture
+//
+//   bake_texture <input image> <output.cgtex> [--flip]
+//   bake_texture <input image> <output.cgvt> --virtual [tile size] [--flip]
+
+#include <glad/glad.h>
+
+#include "texture.h"
+#include "virtual_texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "usage: " << argv[0] << " <input image> <output.cgtex> [--flip]" << std::endl;
+    std::cout << "       " << argv[0] << " <input image> <output.cgvt> --virtual [tile size] [--flip]" << std::endl;
+    return 1;
+  }
+  bool flip = false, virtual_texture = false;
+  int tile_size = 128;
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--flip") == 0) {
+      flip = true;
+    } else if (strcmp(argv[i], "--virtual") == 0) {
+      virtual_texture = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-')
+        tile_size = atoi(argv[++i]);
+    }
+  }
+  if (tile_size <= 0) {
+    std::cout << "tile size must be positive" << std::endl;
+    return 1;
+  }
+
+  // virtual textures are always stored as RGBA8
+  Image image;
+  if (!load_image(argv[1], flip, virtual_texture ? 4 : 0, image))
+    return 1;
+
+  bool ok = virtual_texture ? write_virtual_texture(argv[2], image, tile_size)
+                            : write_raw_texture(argv[2], image.pixels.data(), image.width, image.height, image.channels);
+  return ok ? 0 : 1;
+}
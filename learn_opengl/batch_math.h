@@ -0,0 +1,227 @@
+#ifndef BATCH_MATH_H
+#define BATCH_MATH_H
+
+#include <glm/glm.hpp>
+
+#include "entity_store.h"
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BATCH_MATH_SSE
+#define BATCH_MATH_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BATCH_MATH_AVX2_TARGET
+#else
+#define BATCH_MATH_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+// the kernels behind batch_mvp_matrices, fastest last
+enum BatchMathPath { BATCH_SCALAR, BATCH_SSE, BATCH_AVX2 };
+
+inline const char *batch_path_name(BatchMathPath path) {
+  const char *names[] = {"scalar", "sse", "avx2"};
+  return names[path];
+}
+
+// AVX2 and FMA are checked at run time, so one binary runs everywhere and
+// still uses them where they exist
+inline bool cpu_has_avx2_fma() {
+#if defined(BATCH_MATH_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool fma = (info[2] >> 12) & 1, osxsave = (info[2] >> 27) & 1, avx = (info[2] >> 28) & 1;
+  if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6) // the OS saves the ymm registers
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 5) & 1;
+#elif defined(BATCH_MATH_AVX2)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+  return false;
+#endif
+}
+
+inline bool batch_path_supported(BatchMathPath path) {
+  static const bool avx2 = cpu_has_avx2_fma();
+  switch (path) {
+  case BATCH_SCALAR:
+    return true;
+#ifdef BATCH_MATH_SSE
+  case BATCH_SSE:
+    return true;
+#endif
+  case BATCH_AVX2:
+    return avx2;
+  default:
+    return false;
+  }
+}
+
+inline BatchMathPath best_batch_path() {
+  static const BatchMathPath best = batch_path_supported(BATCH_AVX2)  ? BATCH_AVX2
+                                    : batch_path_supported(BATCH_SSE) ? BATCH_SSE
+                                                                      : BATCH_SCALAR;
+  return best;
+}
+
+// one entity's rotation times scale, the upper 3x3 of its world matrix, m[column][row]
+inline void entity_basis(const EntityStore &store, size_t i, float m[3][3]) {
+  float x = store.rotation_x[i], y = store.rotation_y[i], z = store.rotation_z[i], w = store.rotation_w[i];
+  float s = store.scale[i];
+  m[0][0] = s * (1.0f - 2.0f * (y * y + z * z));
+  m[0][1] = s * 2.0f * (x * y + w * z);
+  m[0][2] = s * 2.0f * (x * z - w * y);
+  m[1][0] = s * 2.0f * (x * y - w * z);
+  m[1][1] = s * (1.0f - 2.0f * (x * x + z * z));
+  m[1][2] = s * 2.0f * (y * z + w * x);
+  m[2][0] = s * 2.0f * (x * z + w * y);
+  m[2][1] = s * 2.0f * (y * z - w * x);
+  m[2][2] = s * (1.0f - 2.0f * (x * x + y * y));
+}
+
+// The world matrix has a fourth row of (0, 0, 0, 1), so view_projection *
+// world is three columns of three multiply-adds each plus the translated
+// fourth: 48 multiplies instead of glm's 64, and none of the identity
+// matrix work translate() and rotate() do.
+inline void batch_mvp_scalar(const EntityStore &store, size_t begin, size_t end, const glm::mat4 &vp,
+                             glm::mat4 *out) {
+  for (size_t i = begin; i < end; i++) {
+    float m[3][3];
+    entity_basis(store, i, m);
+    glm::mat4 &result = out[i - begin];
+    for (int column = 0; column < 3; column++)
+      result[column] = vp[0] * m[column][0] + vp[1] * m[column][1] + vp[2] * m[column][2];
+    result[3] = vp[0] * store.position_x[i] + vp[1] * store.position_y[i] + vp[2] * store.position_z[i] + vp[3];
+  }
+}
+
+#ifdef BATCH_MATH_SSE
+// the same, one output column per register
+inline void batch_mvp_sse(const EntityStore &store, size_t begin, size_t end, const glm::mat4 &vp, glm::mat4 *out) {
+  __m128 v0 = _mm_loadu_ps(&vp[0][0]), v1 = _mm_loadu_ps(&vp[1][0]);
+  __m128 v2 = _mm_loadu_ps(&vp[2][0]), v3 = _mm_loadu_ps(&vp[3][0]);
+  for (size_t i = begin; i < end; i++) {
+    float m[3][3];
+    entity_basis(store, i, m);
+    float *result = &out[i - begin][0][0];
+    for (int column = 0; column < 3; column++) {
+      __m128 c = _mm_mul_ps(v0, _mm_set1_ps(m[column][0]));
+      c = _mm_add_ps(c, _mm_mul_ps(v1, _mm_set1_ps(m[column][1])));
+      c = _mm_add_ps(c, _mm_mul_ps(v2, _mm_set1_ps(m[column][2])));
+      _mm_storeu_ps(result + column * 4, c);
+    }
+    __m128 c = _mm_add_ps(v3, _mm_mul_ps(v0, _mm_set1_ps(store.position_x[i])));
+    c = _mm_add_ps(c, _mm_mul_ps(v1, _mm_set1_ps(store.position_y[i])));
+    c = _mm_add_ps(c, _mm_mul_ps(v2, _mm_set1_ps(store.position_z[i])));
+    _mm_storeu_ps(result + 12, c);
+  }
+}
+#endif
+
+#ifdef BATCH_MATH_AVX2
+// rows[k] lane e becomes rows[e] lane k
+BATCH_MATH_AVX2_TARGET inline void transpose_8x8(__m256 rows[8]) {
+  __m256 t[8], s[8];
+  for (int k = 0; k < 8; k += 2) {
+    t[k] = _mm256_unpacklo_ps(rows[k], rows[k + 1]);
+    t[k + 1] = _mm256_unpackhi_ps(rows[k], rows[k + 1]);
+  }
+  for (int k = 0; k < 8; k += 4) {
+    s[k] = _mm256_shuffle_ps(t[k], t[k + 2], 0x44);
+    s[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], 0xEE);
+    s[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], 0x44);
+    s[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], 0xEE);
+  }
+  for (int k = 0; k < 4; k++) {
+    rows[k] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x20);
+    rows[k + 4] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x31);
+  }
+}
+
+// eight entities per iteration, one entity per lane: the inputs are plain
+// loads from the store's arrays, each of the 16 output elements is three
+// FMAs, and two 8x8 transposes turn the lanes into eight matrices
+BATCH_MATH_AVX2_TARGET inline void batch_mvp_avx2(const EntityStore &store, size_t begin, size_t end,
+                                                  const glm::mat4 &vp, glm::mat4 *out) {
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 x = _mm256_loadu_ps(&store.rotation_x[i]), y = _mm256_loadu_ps(&store.rotation_y[i]);
+    __m256 z = _mm256_loadu_ps(&store.rotation_z[i]), w = _mm256_loadu_ps(&store.rotation_w[i]);
+    __m256 s = _mm256_loadu_ps(&store.scale[i]);
+    __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+    __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+    __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+    __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 m[4][3] = {
+        {_mm256_mul_ps(s, _mm256_sub_ps(one, _mm256_add_ps(yy, zz))), _mm256_mul_ps(s, _mm256_add_ps(xy, wz)),
+         _mm256_mul_ps(s, _mm256_sub_ps(xz, wy))},
+        {_mm256_mul_ps(s, _mm256_sub_ps(xy, wz)), _mm256_mul_ps(s, _mm256_sub_ps(one, _mm256_add_ps(xx, zz))),
+         _mm256_mul_ps(s, _mm256_add_ps(yz, wx))},
+        {_mm256_mul_ps(s, _mm256_add_ps(xz, wy)), _mm256_mul_ps(s, _mm256_sub_ps(yz, wx)),
+         _mm256_mul_ps(s, _mm256_sub_ps(one, _mm256_add_ps(xx, yy)))},
+        {_mm256_loadu_ps(&store.position_x[i]), _mm256_loadu_ps(&store.position_y[i]),
+         _mm256_loadu_ps(&store.position_z[i])},
+    };
+
+    __m256 elements[16];
+    for (int row = 0; row < 4; row++) {
+      __m256 v0 = _mm256_set1_ps(vp[0][row]), v1 = _mm256_set1_ps(vp[1][row]);
+      __m256 v2 = _mm256_set1_ps(vp[2][row]), v3 = _mm256_set1_ps(vp[3][row]);
+      for (int column = 0; column < 4; column++) {
+        __m256 e = column == 3 ? _mm256_fmadd_ps(v2, m[3][2], v3) : _mm256_mul_ps(v2, m[column][2]);
+        e = _mm256_fmadd_ps(v1, m[column][1], e);
+        elements[column * 4 + row] = _mm256_fmadd_ps(v0, m[column][0], e);
+      }
+    }
+
+    transpose_8x8(elements);     // columns 0 and 1 of each entity
+    transpose_8x8(elements + 8); // columns 2 and 3
+    for (int e = 0; e < 8; e++) {
+      float *result = &out[i - begin + e][0][0];
+      _mm256_storeu_ps(result, elements[e]);
+      _mm256_storeu_ps(result + 8, elements[8 + e]);
+    }
+  }
+  batch_mvp_scalar(store, i, end, vp, out + (i - begin));
+}
+#endif
+
+// view_projection * world matrix of entities [begin, end) of the store to
+// out[0..end-begin), built straight from the arrays; `path` picks the kernel
+// (falling back to the best supported one), the default is the fastest
+inline void batch_mvp_matrices(const EntityStore &store, size_t begin, size_t end, const glm::mat4 &view_projection,
+                               glm::mat4 *out, BatchMathPath path = best_batch_path()) {
+  if (!batch_path_supported(path))
+    path = best_batch_path();
+#ifdef BATCH_MATH_AVX2
+  if (path == BATCH_AVX2) {
+    batch_mvp_avx2(store, begin, end, view_projection, out);
+    return;
+  }
+#endif
+#ifdef BATCH_MATH_SSE
+  if (path == BATCH_SSE) {
+    batch_mvp_sse(store, begin, end, view_projection, out);
+    return;
+  }
+#endif
+  batch_mvp_scalar(store, begin, end, view_projection, out);
+}
+
+// world matrices only
+inline void batch_model_matrices(const EntityStore &store, size_t begin, size_t end, glm::mat4 *out,
+                                 BatchMathPath path = best_batch_path()) {
+  batch_mvp_matrices(store, begin, end, glm::mat4(1.0f), out, path);
+}
+
+#endif // BATCH_MATH_H
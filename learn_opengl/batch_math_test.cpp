@@ -0,0 +1,118 @@
+// checks every supported batch_mvp_matrices kernel against glm
+//
+//   batch_math_test
+//
+// Random entities (position, rotation around a random axis, scale) are
+// turned into view_projection * world matrices by each kernel and by
+// glm::translate/rotate/scale; exits non-zero if an element differs by more
+// than the tolerance, relative to its magnitude. Ranges of every length up to
+// a few AVX2 blocks and ones that start mid-store exercise the scalar tails,
+// and a guard matrix after each range catches writes past its end.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "batch_math.h"
+#include "entity_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const float tolerance = 1e-5f;
+
+struct Reference {
+  EntityStore store;
+  std::vector<glm::mat4> expected;
+};
+
+Reference make_entities(size_t count, const glm::mat4 &view_projection) {
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  Reference reference;
+  reference.store.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 position = glm::vec3(unit(random), unit(random), unit(random)) * 100.0f;
+    glm::vec3 axis(unit(random), unit(random), unit(random));
+    if (glm::length(axis) < 0.01f)
+      axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float angle = unit(random) * 3.14159265f, scale = std::exp2(unit(random) * 3.0f);
+
+    EntityDesc entity;
+    entity.position = position;
+    entity.rotation = axis_angle(axis, angle);
+    entity.scale = scale;
+    reference.store.add(entity);
+
+    glm::mat4 world = glm::translate(glm::mat4(1.0f), position);
+    world = glm::rotate(world, angle, glm::normalize(axis));
+    world = glm::scale(world, glm::vec3(scale));
+    reference.expected.push_back(view_projection * world);
+  }
+  return reference;
+}
+
+// largest element error of out[0..end-begin) relative to max(1, |expected|)
+float max_error(const Reference &reference, size_t begin, size_t end, const glm::mat4 *out) {
+  float error = 0.0f;
+  for (size_t i = begin; i < end; i++)
+    for (int column = 0; column < 4; column++)
+      for (int row = 0; row < 4; row++) {
+        float expected = reference.expected[i][column][row];
+        float difference = std::fabs(out[i - begin][column][row] - expected);
+        error = std::max(error, difference / std::max(1.0f, std::fabs(expected)));
+      }
+  return error;
+}
+
+int main() {
+  const size_t count = 1000;
+  glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f) *
+                              glm::lookAt(glm::vec3(0.0f, 0.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Reference reference = make_entities(count, view_projection);
+
+  // (begin, end) pairs: every length from 0 to 33 at offsets 0, 1 and 5,
+  // then the whole store and a long range with a ragged start and end
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t begin : {0, 1, 5})
+    for (size_t length = 0; length <= 33; length++)
+      ranges.push_back({begin, begin + length});
+  ranges.push_back({0, count});
+  ranges.push_back({3, count - 2});
+
+  const unsigned char guard_byte = 0xcd;
+  glm::mat4 guard;
+  std::memset(&guard, guard_byte, sizeof(guard));
+
+  int failures = 0;
+  for (BatchMathPath path : {BATCH_SCALAR, BATCH_SSE, BATCH_AVX2}) {
+    if (!batch_path_supported(path)) {
+      std::cout << batch_path_name(path) << ": not supported, skipped" << std::endl;
+      continue;
+    }
+    float worst = 0.0f;
+    for (const auto &range : ranges) {
+      size_t length = range.second - range.first;
+      std::vector<glm::mat4> out(length + 1, guard);
+      batch_mvp_matrices(reference.store, range.first, range.second, view_projection, out.data(), path);
+      float error = max_error(reference, range.first, range.second, out.data());
+      worst = std::max(worst, error);
+      if (!(error <= tolerance)) {
+        std::cout << "ERROR::BATCH_MATH_TEST::MISMATCH: " << batch_path_name(path) << " [" << range.first << ", "
+                  << range.second << ") differs from glm by " << error << std::endl;
+        failures++;
+      }
+      if (std::memcmp(&out[length], &guard, sizeof(guard)) != 0) {
+        std::cout << "ERROR::BATCH_MATH_TEST::OVERRUN: " << batch_path_name(path) << " [" << range.first << ", "
+                  << range.second << ") wrote past its end" << std::endl;
+        failures++;
+      }
+    }
+    std::cout << batch_path_name(path) << ": " << ranges.size() << " ranges, max relative error " << worst
+              << std::endl;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,596 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "glad/glad.h"
+
+#include "gl_resource.h"
+#include "gpu_memory.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// index of the highest and the lowest set bit, x must not be 0
+inline int tlsf_fls(uint32_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanReverse(&index, x);
+  return (int)index;
+#else
+  return 31 - __builtin_clz(x);
+#endif
+}
+
+inline int tlsf_ffs(uint32_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return (int)index;
+#else
+  return __builtin_ctz(x);
+#endif
+}
+
+// two-level segregated fit allocator over the byte range [0, capacity)
+//
+// Only the bookkeeping, it never touches memory, so it can hand out ranges
+// of a GL buffer. Free blocks sit in lists by size class: the first level
+// is the power of two, the second splits it into SL_COUNT linear steps.
+// Two bitmaps find a non-empty list that fits, so allocate() and free() take
+// constant time whatever the number of blocks. Freed blocks are merged with
+// free neighbours at once.
+//
+// Offsets and sizes are in multiples of 4 bytes, alignments are any
+// multiple of 4 (a vertex stride of 20 works, base vertex = offset / 20).
+class TlsfAllocator {
+public:
+  static constexpr uint32_t NONE = 0xffffffffu;
+  static constexpr uint32_t GRANULARITY = 4;
+
+  void init(uint32_t capacity_bytes) {
+    blocks.clear();
+    unused_blocks.clear();
+    fl_bitmap = 0;
+    std::fill(sl_bitmap, sl_bitmap + FL_COUNT, 0u);
+    for (int fl = 0; fl < FL_COUNT; fl++)
+      std::fill(heads[fl], heads[fl] + SL_COUNT, NONE);
+    capacity = capacity_bytes / GRANULARITY * GRANULARITY;
+    used_bytes = 0;
+    first = new_block(0, capacity);
+    insert_free(first);
+  }
+
+  // a block of at least `size` bytes at a multiple of `alignment`, or NONE
+  uint32_t allocate(uint32_t size, uint32_t alignment) {
+    size = round_up(std::max(size, GRANULARITY), GRANULARITY);
+    alignment = round_up(std::max(alignment, GRANULARITY), GRANULARITY);
+    uint32_t search = size + (alignment - GRANULARITY); // room for the padding
+    if (search < size || search > capacity)
+      return NONE;
+    uint32_t block = find_free(search);
+    if (block == NONE)
+      return NONE;
+    remove_free(block);
+
+    uint32_t aligned = round_up(blocks[block].offset, alignment);
+    if (aligned > blocks[block].offset) {
+      // the padding in front stays free; the previous block is in use, free
+      // neighbours are always merged
+      uint32_t pad = split(block, aligned - blocks[block].offset);
+      std::swap(block, pad);
+      insert_free(pad);
+    }
+    if (blocks[block].size > size)
+      insert_free(split(block, size));
+    blocks[block].free = false;
+    blocks[block].alignment = alignment;
+    used_bytes += blocks[block].size;
+    return block;
+  }
+
+  void free(uint32_t block) {
+    if (block >= blocks.size() || blocks[block].free) {
+      std::cout << "ERROR::TLSF::INVALID_FREE: block " << block << std::endl;
+      return;
+    }
+    used_bytes -= blocks[block].size;
+    blocks[block].free = true;
+    uint32_t next = blocks[block].next;
+    if (next != NONE && blocks[next].free) {
+      remove_free(next);
+      block = merge(block, next);
+    }
+    uint32_t prev = blocks[block].prev;
+    if (prev != NONE && blocks[prev].free) {
+      remove_free(prev);
+      block = merge(prev, block);
+    }
+    insert_free(block);
+  }
+
+  // the capacity of an allocator that can hand out a block of `size` bytes at
+  // `alignment` while empty: find_free looks for a size class that fits
+  // the worst-case padding, not for the exact size; NONE if none is that big
+  static uint32_t capacity_for(uint32_t size, uint32_t alignment) {
+    size = round_up(std::max(size, GRANULARITY), GRANULARITY);
+    alignment = round_up(std::max(alignment, GRANULARITY), GRANULARITY);
+    uint32_t search = size + (alignment - GRANULARITY);
+    if (search < size)
+      return NONE;
+    uint64_t rounded = round_up_to_class(search);
+    return rounded > 0xffffffffu - GRANULARITY ? NONE : round_up((uint32_t)rounded, GRANULARITY);
+  }
+
+  uint32_t offset(uint32_t block) const { return blocks[block].offset; }
+  uint32_t size(uint32_t block) const { return blocks[block].size; }
+  uint32_t used() const { return used_bytes; }
+  uint32_t total() const { return capacity; }
+  bool empty() const { return used_bytes == 0; }
+
+  uint32_t largest_free() const {
+    if (!fl_bitmap)
+      return 0;
+    int fl = tlsf_fls(fl_bitmap);
+    uint32_t largest = 0;
+    for (uint32_t block = heads[fl][tlsf_fls(sl_bitmap[fl])]; block != NONE; block = blocks[block].next_free)
+      largest = std::max(largest, blocks[block].size);
+    return largest;
+  }
+
+  // moves the lowest block in use that has free space in front of it down
+  // into that space and returns it, with its old and new offset; NONE when
+  // nothing can move. The caller copies the contents.
+  uint32_t compact_step(uint32_t &from, uint32_t &to) {
+    for (uint32_t block = first; block != NONE; block = blocks[block].next) {
+      uint32_t prev = blocks[block].prev;
+      if (blocks[block].free || prev == NONE || !blocks[prev].free)
+        continue;
+      uint32_t target = round_up(blocks[prev].offset, blocks[block].alignment);
+      if (target >= blocks[block].offset)
+        continue; // only padding in front
+      from = blocks[block].offset;
+      to = target;
+      slide_down(block, to);
+      return block;
+    }
+    return NONE;
+  }
+
+private:
+  static const int SL_LOG2 = 4;
+  static const int SL_COUNT = 1 << SL_LOG2;
+  static const int SMALL_LOG2 = 8; // below 256 bytes the classes are linear
+  static const uint32_t SMALL = 1u << SMALL_LOG2;
+  static const int FL_COUNT = 32 - SMALL_LOG2 + 1;
+
+  struct Block {
+    uint32_t offset, size;
+    uint32_t alignment;  // in use: what it was allocated with
+    uint32_t prev, next; // neighbours by offset
+    uint32_t prev_free, next_free;
+    bool free;
+  };
+
+  std::vector<Block> blocks;
+  std::vector<uint32_t> unused_blocks; // records to reuse
+  uint32_t first = NONE;               // the block at offset 0
+  uint32_t capacity = 0;
+  uint32_t used_bytes = 0;
+  uint32_t fl_bitmap = 0;
+  uint32_t sl_bitmap[FL_COUNT];
+  uint32_t heads[FL_COUNT][SL_COUNT];
+
+  static uint32_t round_up(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  static void mapping(uint32_t size, int &fl, int &sl) {
+    if (size < SMALL) {
+      fl = 0;
+      sl = (int)(size / (SMALL / SL_COUNT));
+    } else {
+      int bit = tlsf_fls(size);
+      sl = (int)((size >> (bit - SL_LOG2)) ^ SL_COUNT);
+      fl = bit - SMALL_LOG2 + 1;
+    }
+  }
+
+  // the smallest size whose class only has blocks of at least `size`
+  static uint64_t round_up_to_class(uint32_t size) {
+    uint32_t step = size < SMALL ? SMALL / SL_COUNT : 1u << (tlsf_fls(size) - SL_LOG2);
+    return ((uint64_t)size + step - 1) / step * step;
+  }
+
+  // the first non-empty list whose every block holds `size`
+  uint32_t find_free(uint32_t size) const {
+    uint64_t rounded = round_up_to_class(size);
+    if (rounded > 0xffffffffu)
+      return NONE;
+    int fl, sl;
+    mapping((uint32_t)rounded, fl, sl);
+    uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+      uint32_t fl_map = fl + 1 < 32 ? fl_bitmap & (~0u << (fl + 1)) : 0;
+      if (!fl_map)
+        return NONE;
+      fl = tlsf_ffs(fl_map);
+      sl_map = sl_bitmap[fl];
+    }
+    return heads[fl][tlsf_ffs(sl_map)];
+  }
+
+  uint32_t new_block(uint32_t offset, uint32_t size) {
+    Block block = {offset, size, GRANULARITY, NONE, NONE, NONE, NONE, true};
+    if (!unused_blocks.empty()) {
+      uint32_t index = unused_blocks.back();
+      unused_blocks.pop_back();
+      blocks[index] = block;
+      return index;
+    }
+    blocks.push_back(block);
+    return (uint32_t)blocks.size() - 1;
+  }
+
+  void insert_free(uint32_t block) {
+    int fl, sl;
+    mapping(blocks[block].size, fl, sl);
+    blocks[block].free = true;
+    blocks[block].prev_free = NONE;
+    blocks[block].next_free = heads[fl][sl];
+    if (heads[fl][sl] != NONE)
+      blocks[heads[fl][sl]].prev_free = block;
+    heads[fl][sl] = block;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+  }
+
+  void remove_free(uint32_t block) {
+    int fl, sl;
+    mapping(blocks[block].size, fl, sl);
+    uint32_t prev = blocks[block].prev_free, next = blocks[block].next_free;
+    if (prev != NONE)
+      blocks[prev].next_free = next;
+    else
+      heads[fl][sl] = next;
+    if (next != NONE)
+      blocks[next].prev_free = prev;
+    if (heads[fl][sl] == NONE) {
+      sl_bitmap[fl] &= ~(1u << sl);
+      if (!sl_bitmap[fl])
+        fl_bitmap &= ~(1u << fl);
+    }
+  }
+
+  // cuts `block` after `size` bytes and returns the new block behind it,
+  // neither is in a free list
+  uint32_t split(uint32_t block, uint32_t size) {
+    uint32_t rest = new_block(blocks[block].offset + size, blocks[block].size - size);
+    blocks[block].size = size;
+    blocks[rest].prev = block;
+    blocks[rest].next = blocks[block].next;
+    if (blocks[rest].next != NONE)
+      blocks[blocks[rest].next].prev = rest;
+    blocks[block].next = rest;
+    return rest;
+  }
+
+  // `b` follows `a`; returns `a` grown by `b`
+  uint32_t merge(uint32_t a, uint32_t b) {
+    blocks[a].size += blocks[b].size;
+    blocks[a].next = blocks[b].next;
+    if (blocks[a].next != NONE)
+      blocks[blocks[a].next].prev = a;
+    unused_blocks.push_back(b);
+    return a;
+  }
+
+  // `block` in use moves to `to`, inside the free block in front of it
+  void slide_down(uint32_t block, uint32_t to) {
+    uint32_t prev = blocks[block].prev;
+    uint32_t gap = blocks[block].offset - to;
+    remove_free(prev);
+    if (blocks[prev].offset == to) {
+      // the whole free block moves behind
+      uint32_t before = blocks[prev].prev;
+      blocks[block].prev = before;
+      if (before != NONE)
+        blocks[before].next = block;
+      else
+        first = block;
+      unused_blocks.push_back(prev);
+    } else {
+      blocks[prev].size = to - blocks[prev].offset; // padding stays in front
+      insert_free(prev);
+    }
+    blocks[block].offset = to;
+
+    uint32_t next = blocks[block].next;
+    if (next != NONE && blocks[next].free) {
+      remove_free(next);
+      blocks[next].offset -= gap;
+      blocks[next].size += gap;
+      insert_free(next);
+    } else {
+      uint32_t hole = new_block(to + blocks[block].size, gap);
+      blocks[hole].prev = block;
+      blocks[hole].next = next;
+      if (next != NONE)
+        blocks[next].prev = hole;
+      blocks[block].next = hole;
+      insert_free(hole);
+    }
+  }
+};
+
+// refers to a range of a BufferPool until it is freed; moves by
+// defragment() don't change it
+struct BufferRange {
+  uint32_t slot = 0;
+  uint32_t generation = 0;
+
+  explicit operator bool() const { return slot != 0; }
+};
+
+// vertices, indices and uniform blocks of many meshes in a few large buffers
+//
+//   meshes.init(4 << 20, GL_STATIC_DRAW, "meshes");
+//   BufferRange vertices = meshes.allocate(sizeof(cube_vertices), 5 * sizeof(float), cube_vertices);
+//   ...
+//   glBindVertexArray(VAO); // attributes at offset 0 of meshes.buffer(vertices)
+//   glDrawArrays(GL_TRIANGLES, (GLint)(meshes.offset(vertices) / (5 * sizeof(float))), 36);
+//   ...
+//   meshes.defragment(256 * 1024); // after the swap
+//
+// Each page is one buffer object split by a TlsfAllocator; a range bigger
+// than a page gets a page of its own. Meshes of one vertex format in a page
+// share one VAO and are drawn with a base vertex
+// (glDrawElementsBaseVertex) instead of a bind per mesh. Align vertices to
+// their stride, indices to their size and uniform blocks to
+// uniform_alignment().
+//
+// Ranges are freed in any order, which leaves holes. defragment() slides
+// ranges down into the holes with glCopyBufferSubData, so the free space
+// gathers at the end of each page. GL orders the copy after the draws
+// already submitted, which still read the old place, so nothing waits.
+// A moved range has a new offset: resolve offset() every frame instead of
+// keeping it, e.g. in attribute pointers.
+class BufferPool {
+public:
+  size_t page_size = 0;
+  GLenum usage = GL_STATIC_DRAW;
+  const char *owner = "buffer pool";
+  size_t moved = 0;  // bytes moved by defragment() so far
+  long moves = 0;
+
+  void init(size_t bytes_per_page, GLenum buffer_usage, const char *memory_owner) {
+    page_size = bytes_per_page;
+    usage = buffer_usage;
+    owner = memory_owner;
+    slots.assign(1, Slot());
+  }
+
+  // `data` may be NULL to fill the range later with upload()
+  BufferRange allocate(size_t bytes, size_t alignment, const void *data) {
+    if (bytes == 0 || bytes > 0x7fffffff || alignment == 0 || alignment % TlsfAllocator::GRANULARITY != 0) {
+      std::cout << "ERROR::BUFFER_POOL::INVALID_ALLOCATION: " << bytes << " bytes aligned to " << alignment
+                << std::endl;
+      return BufferRange();
+    }
+    uint32_t page = 0, block = TlsfAllocator::NONE;
+    for (; page < pages.size() && block == TlsfAllocator::NONE; page++)
+      if (pages[page].buffer)
+        block = pages[page].blocks.allocate((uint32_t)bytes, (uint32_t)alignment);
+    if (block == TlsfAllocator::NONE) {
+      // a fresh page the size class of the range fits in, a page of its own
+      // if that is more than page_size
+      uint32_t capacity = TlsfAllocator::capacity_for((uint32_t)bytes, (uint32_t)alignment);
+      if (capacity != TlsfAllocator::NONE) {
+        page = add_page(std::max(page_size, (size_t)capacity));
+        block = pages[page].blocks.allocate((uint32_t)bytes, (uint32_t)alignment);
+      }
+      if (block == TlsfAllocator::NONE) {
+        std::cout << "ERROR::BUFFER_POOL::ALLOCATION_FAILED: " << bytes << " bytes aligned to " << alignment
+                  << std::endl;
+        if (capacity != TlsfAllocator::NONE && pages[page].ranges == 0 && page != 0)
+          pages[page].buffer.reset();
+        return BufferRange();
+      }
+    } else {
+      page--;
+    }
+
+    uint32_t slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = (uint32_t)slots.size();
+      slots.push_back(Slot());
+    }
+    pages[page].ranges++;
+    slots[slot].page = page;
+    slots[slot].block = block;
+    slots[slot].bytes = bytes;
+    BufferRange range;
+    range.slot = slot;
+    range.generation = slots[slot].generation;
+    if (data)
+      upload(range, data, bytes);
+    return range;
+  }
+
+  void free(BufferRange range) {
+    if (!alive(range))
+      return;
+    Slot &slot = slots[range.slot];
+    Page &page = pages[slot.page];
+    page.blocks.free(slot.block);
+    page.ranges--;
+    if (page.ranges == 0 && slot.page != 0) {
+      page.buffer.reset(); // deleted once the frames drawing from it are done
+    }
+    slot.generation++;
+    free_slots.push_back(range.slot);
+  }
+
+  bool alive(BufferRange range) const {
+    return range.slot != 0 && range.slot < slots.size() && slots[range.slot].generation == range.generation;
+  }
+
+  unsigned int buffer(BufferRange range) const {
+    return alive(range) ? pages[slots[range.slot].page].buffer.name() : 0;
+  }
+
+  size_t offset(BufferRange range) const {
+    return alive(range) ? pages[slots[range.slot].page].blocks.offset(slots[range.slot].block) : 0;
+  }
+
+  size_t size(BufferRange range) const { return alive(range) ? slots[range.slot].bytes : 0; }
+
+  // through GL_COPY_WRITE_BUFFER, so the bound VAO's element buffer stays
+  void upload(BufferRange range, const void *data, size_t bytes) {
+    if (!alive(range) || bytes > slots[range.slot].bytes)
+      return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer(range));
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset(range), (GLsizeiptr)bytes, data);
+  }
+
+  // moves ranges down into the holes in front of them until `max_bytes`
+  // were copied (at least one range moves if any can); returns the bytes
+  // copied, 0 once the pool is compact
+  size_t defragment(size_t max_bytes) {
+    size_t copied = 0;
+    for (Page &page : pages) {
+      if (!page.buffer)
+        continue;
+      uint32_t from, to, block;
+      while ((copied < max_bytes || copied == 0) &&
+             (block = page.blocks.compact_step(from, to)) != TlsfAllocator::NONE) {
+        uint32_t bytes = page.blocks.size(block);
+        copy_within(page.buffer.name(), from, to, bytes);
+        copied += bytes;
+        moves++;
+      }
+      if (copied >= max_bytes && copied > 0)
+        break;
+    }
+    moved += copied;
+    return copied;
+  }
+
+  size_t used() const {
+    size_t bytes = 0;
+    for (const Page &page : pages)
+      if (page.buffer)
+        bytes += page.blocks.used();
+    return bytes;
+  }
+
+  size_t total() const {
+    size_t bytes = 0;
+    for (const Page &page : pages)
+      if (page.buffer)
+        bytes += page.blocks.total();
+    return bytes;
+  }
+
+  int buffer_count() const {
+    int count = 0;
+    for (const Page &page : pages)
+      count += page.buffer ? 1 : 0;
+    return count;
+  }
+
+  void report(std::ostream &out) const {
+    size_t largest = 0;
+    for (const Page &page : pages)
+      if (page.buffer)
+        largest = std::max(largest, (size_t)page.blocks.largest_free());
+    out << owner << " pool: " << buffer_count() << " buffers, " << GpuMemory::mib(used()) << " of "
+        << GpuMemory::mib(total()) << " MiB used, largest hole " << GpuMemory::mib(largest) << " MiB, " << moves
+        << " moves (" << GpuMemory::mib(moved) << " MiB) by defragment" << std::endl;
+  }
+
+  // every range goes with it
+  void destroy() {
+    for (Page &page : pages)
+      page.buffer.reset();
+    pages.clear();
+    scratch.reset();
+    scratch_bytes = 0;
+    slots.assign(1, Slot());
+    free_slots.clear();
+  }
+
+private:
+  struct Page {
+    GlBuffer buffer; // reset once the page is empty, except page 0
+    TlsfAllocator blocks;
+    size_t ranges = 0;
+  };
+
+  struct Slot {
+    uint32_t page = 0;
+    uint32_t block = 0;
+    size_t bytes = 0; // as asked for, the block may be a little larger
+    uint32_t generation = 0;
+  };
+
+  std::vector<Page> pages;
+  std::vector<Slot> slots; // slot 0 is never used
+  std::vector<uint32_t> free_slots;
+  GlBuffer scratch; // for moves that overlap their old place
+  size_t scratch_bytes = 0;
+
+  uint32_t add_page(size_t bytes) {
+    uint32_t page = 0;
+    while (page < pages.size() && pages[page].buffer)
+      page++;
+    if (page == pages.size())
+      pages.push_back(Page());
+    bytes = (bytes + TlsfAllocator::GRANULARITY - 1) / TlsfAllocator::GRANULARITY * TlsfAllocator::GRANULARITY;
+    pages[page].buffer = GlBuffer::create();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pages[page].buffer.name());
+    tracked_buffer_data(GL_COPY_WRITE_BUFFER, pages[page].buffer.name(), (GLsizeiptr)bytes, NULL, usage, owner);
+    pages[page].blocks.init((uint32_t)bytes);
+    pages[page].ranges = 0;
+    return page;
+  }
+
+  // glCopyBufferSubData can't copy within a buffer when source and
+  // destination overlap, those moves go through the scratch buffer
+  void copy_within(unsigned int buffer, uint32_t from, uint32_t to, uint32_t bytes) {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    if (from - to >= bytes) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, bytes);
+      return;
+    }
+    if (scratch_bytes < bytes) {
+      scratch = GlBuffer::create();
+      scratch_bytes = bytes;
+      glBindBuffer(GL_COPY_WRITE_BUFFER, scratch.name());
+      tracked_buffer_data(GL_COPY_WRITE_BUFFER, scratch.name(), (GLsizeiptr)bytes, NULL, GL_STREAM_COPY, owner);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, scratch.name());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, 0, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, scratch.name());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, to, bytes);
+  }
+};
+
+// what uniform block ranges have to be aligned to
+inline size_t uniform_alignment() {
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  return (size_t)std::max(alignment, 4);
+}
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,269 @@
+// stress test of TlsfAllocator and BufferPool
+//
+//   buffer_pool_test [--headless]
+//
+// Random allocate/free sequences with defragmentation in between, against a
+// copy of what every range should hold. After each round every range has to
+// be at a multiple of its alignment, inside its page, clear of the others
+// and still hold its bytes. The allocators include capacities and page
+// sizes that aren't multiples of 4 and ranges bigger than a page. TlsfAllocator
+// is checked against a byte array that follows compact_step(); BufferPool
+// against its GL buffers, so that part needs a context and only runs with
+// --headless. Exits non-zero on the first broken range.
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#include "buffer_pool.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const uint32_t alignments[] = {4, 8, 12, 20, 64, 256};
+
+// the bytes of the range allocated as number `id`
+uint8_t pattern(uint32_t id, size_t byte) { return (uint8_t)(id * 131 + byte * 7 + (byte >> 8)); }
+
+bool fail(const char *what, const std::string &detail) {
+  std::cout << "ERROR::BUFFER_POOL_TEST::" << what << ": " << detail << std::endl;
+  return false;
+}
+
+// TlsfAllocator
+// -------------
+struct TlsfRange {
+  uint32_t block, bytes, alignment, id;
+};
+
+bool check_tlsf(const TlsfAllocator &blocks, const std::vector<TlsfRange> &ranges, const std::vector<uint8_t> &memory,
+                const std::string &name) {
+  std::vector<std::pair<uint32_t, uint32_t>> spans; // offset, end
+  uint32_t used = 0;
+  for (const TlsfRange &range : ranges) {
+    uint32_t offset = blocks.offset(range.block), size = blocks.size(range.block);
+    std::string where = name + " block " + std::to_string(range.block) + " at " + std::to_string(offset);
+    if (offset % range.alignment != 0)
+      return fail("MISALIGNED", where + " aligned to " + std::to_string(range.alignment));
+    if (size < range.bytes || offset + size > blocks.total())
+      return fail("OUT_OF_RANGE", where + ", " + std::to_string(size) + " bytes");
+    for (uint32_t byte = 0; byte < range.bytes; byte++)
+      if (memory[offset + byte] != pattern(range.id, byte))
+        return fail("CONTENTS_LOST", where + ", byte " + std::to_string(byte));
+    spans.push_back({offset, offset + size});
+    used += size;
+  }
+  std::sort(spans.begin(), spans.end());
+  for (size_t i = 1; i < spans.size(); i++)
+    if (spans[i].first < spans[i - 1].second)
+      return fail("OVERLAP", name + " at " + std::to_string(spans[i].first));
+  if (used != blocks.used())
+    return fail("USED_MISMATCH", name + ": " + std::to_string(blocks.used()) + " instead of " + std::to_string(used));
+  return true;
+}
+
+// every move of compact_step() is copied in `memory` like BufferPool does
+// in its buffers; at most `steps` moves, NONE stops early
+int compact(TlsfAllocator &blocks, std::vector<uint8_t> &memory, int steps) {
+  int moves = 0;
+  uint32_t from, to, block;
+  while (moves < steps && (block = blocks.compact_step(from, to)) != TlsfAllocator::NONE) {
+    std::memmove(&memory[to], &memory[from], blocks.size(block));
+    moves++;
+  }
+  return moves;
+}
+
+bool stress_tlsf(uint32_t capacity, uint32_t seed) {
+  std::string name = "tlsf " + std::to_string(capacity);
+  std::mt19937 random(seed);
+  TlsfAllocator blocks;
+  blocks.init(capacity);
+  std::vector<uint8_t> memory(blocks.total());
+  std::vector<TlsfRange> ranges;
+  uint32_t next_id = 0;
+
+  for (int step = 0; step < 4000; step++) {
+    if (ranges.empty() || random() % 100 < 55) {
+      uint32_t limit = random() % 10 == 0 ? capacity + capacity / 4 : std::max(capacity / 16, 8u);
+      TlsfRange range = {0, 1 + (uint32_t)(random() % limit), alignments[random() % 6], next_id++};
+      range.block = blocks.allocate(range.bytes, range.alignment);
+      if (range.block == TlsfAllocator::NONE) {
+        if (blocks.empty() && TlsfAllocator::capacity_for(range.bytes, range.alignment) <= blocks.total())
+          return fail("ALLOCATION_FAILED", name + ": " + std::to_string(range.bytes) + " bytes in an empty allocator");
+        continue;
+      }
+      for (uint32_t byte = 0; byte < range.bytes; byte++)
+        memory[blocks.offset(range.block) + byte] = pattern(range.id, byte);
+      ranges.push_back(range);
+    } else {
+      size_t index = random() % ranges.size();
+      blocks.free(ranges[index].block);
+      ranges[index] = ranges.back();
+      ranges.pop_back();
+    }
+    if (step % 50 == 49) {
+      compact(blocks, memory, 1 + (int)(random() % 8));
+      if (!check_tlsf(blocks, ranges, memory, name))
+        return false;
+    }
+  }
+
+  // compacting to the end has to stop, and leaves nothing to move
+  int moves = compact(blocks, memory, 1 << 20);
+  uint32_t from, to;
+  if (blocks.compact_step(from, to) != TlsfAllocator::NONE)
+    return fail("COMPACT_UNFINISHED", name + " after " + std::to_string(moves) + " moves");
+  if (!check_tlsf(blocks, ranges, memory, name))
+    return false;
+  for (const TlsfRange &range : ranges)
+    blocks.free(range.block);
+  if (!blocks.empty() || blocks.largest_free() != blocks.total())
+    return fail("LEAK", name + ": " + std::to_string(blocks.used()) + " bytes used after freeing everything");
+  std::cout << name << ": " << next_id << " allocations, " << moves << " moves to compact the rest" << std::endl;
+  return true;
+}
+
+// an empty allocator of capacity_for(size, alignment) has to fit the block,
+// which is how BufferPool sizes a page of its own
+bool check_capacity_for(uint32_t seed) {
+  std::mt19937 random(seed);
+  std::vector<std::pair<uint32_t, uint32_t>> cases = {{70000, 20}, {(5u << 20) + 100, 4}, {1, 4}, {255, 256}};
+  for (int i = 0; i < 2000; i++)
+    cases.push_back({1 + (uint32_t)(random() % (1u << (4 + random() % 20))), alignments[random() % 6]});
+  for (const auto &c : cases) {
+    uint32_t capacity = TlsfAllocator::capacity_for(c.first, c.second);
+    TlsfAllocator blocks;
+    blocks.init(capacity);
+    if (capacity == TlsfAllocator::NONE || blocks.allocate(c.first, c.second) == TlsfAllocator::NONE)
+      return fail("CAPACITY_TOO_SMALL", std::to_string(c.first) + " bytes aligned to " + std::to_string(c.second) +
+                                            " in " + std::to_string(capacity));
+  }
+  if (TlsfAllocator::capacity_for(0xfffffff0u, 256) != TlsfAllocator::NONE)
+    return fail("CAPACITY_OVERFLOW", "0xfffffff0 bytes aligned to 256");
+  std::cout << "capacity_for: " << cases.size() << " sizes" << std::endl;
+  return true;
+}
+
+// BufferPool
+// ----------
+struct PoolRange {
+  BufferRange range;
+  size_t bytes, alignment;
+  uint32_t id;
+};
+
+bool check_pool(const BufferPool &pool, const std::vector<PoolRange> &ranges, const std::string &name) {
+  std::vector<std::pair<unsigned int, std::pair<size_t, size_t>>> spans; // buffer, offset, end
+  std::vector<uint8_t> contents;
+  for (const PoolRange &range : ranges) {
+    unsigned int buffer = pool.buffer(range.range);
+    size_t offset = pool.offset(range.range);
+    std::string where = name + " range " + std::to_string(range.id) + " at " + std::to_string(offset);
+    if (!pool.alive(range.range) || buffer == 0)
+      return fail("RANGE_LOST", where);
+    if (offset % range.alignment != 0)
+      return fail("MISALIGNED", where + " aligned to " + std::to_string(range.alignment));
+    GLint buffer_size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &buffer_size);
+    if (pool.size(range.range) != range.bytes || offset + range.bytes > (size_t)buffer_size)
+      return fail("OUT_OF_RANGE", where + ", buffer of " + std::to_string(buffer_size) + " bytes");
+    contents.resize(range.bytes);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)offset, (GLsizeiptr)range.bytes, contents.data());
+    for (size_t byte = 0; byte < range.bytes; byte++)
+      if (contents[byte] != pattern(range.id, byte))
+        return fail("CONTENTS_LOST", where + ", byte " + std::to_string(byte));
+    spans.push_back({buffer, {offset, offset + range.bytes}});
+  }
+  std::sort(spans.begin(), spans.end());
+  for (size_t i = 1; i < spans.size(); i++)
+    if (spans[i].first == spans[i - 1].first && spans[i].second.first < spans[i - 1].second.second)
+      return fail("OVERLAP", name + " at " + std::to_string(spans[i].second.first));
+  if (glGetError() != GL_NO_ERROR)
+    return fail("GL_ERROR", name);
+  return true;
+}
+
+bool stress_pool(size_t page_size, uint32_t seed) {
+  std::string name = "pool " + std::to_string(page_size);
+  std::mt19937 random(seed);
+  BufferPool pool;
+  pool.init(page_size, GL_STATIC_DRAW, "buffer_pool_test");
+  std::vector<PoolRange> ranges;
+  std::vector<uint8_t> data;
+  uint32_t next_id = 0;
+  // what a range of each size is for: small meshes, meshes around the page
+  // size and above it, and the sizes that overflowed a page of their own
+  const size_t odd_sizes[] = {70000, (5u << 20) + 100, page_size, page_size + 1, page_size * 2 + 3};
+
+  bool passed = true;
+  for (int step = 0; step < 600 && passed; step++) {
+    if (ranges.empty() || random() % 100 < 55) {
+      PoolRange range;
+      unsigned kind = random() % 100;
+      range.bytes = kind < 3    ? odd_sizes[random() % 5]
+                    : kind < 15 ? 1 + random() % (page_size * 2 + 64)
+                                : 1 + random() % std::max(page_size / 8, (size_t)64);
+      range.alignment = alignments[random() % 6];
+      range.id = next_id++;
+      data.resize(range.bytes);
+      for (size_t byte = 0; byte < range.bytes; byte++)
+        data[byte] = pattern(range.id, byte);
+      range.range = pool.allocate(range.bytes, range.alignment, data.data());
+      if (!range.range) {
+        passed = fail("ALLOCATION_FAILED", name + ": " + std::to_string(range.bytes) + " bytes aligned to " +
+                                               std::to_string(range.alignment));
+        break;
+      }
+      ranges.push_back(range);
+    } else {
+      size_t index = random() % ranges.size();
+      pool.free(ranges[index].range);
+      ranges[index] = ranges.back();
+      ranges.pop_back();
+    }
+    if (step % 25 == 24) {
+      pool.defragment(random() % (page_size + 1));
+      passed = check_pool(pool, ranges, name);
+    }
+  }
+
+  if (passed) {
+    while (pool.defragment(1 << 20) > 0) {
+    }
+    passed = check_pool(pool, ranges, name);
+  }
+  if (passed)
+    std::cout << name << ": " << next_id << " allocations, " << pool.buffer_count() << " buffers, " << pool.moves
+              << " moves" << std::endl;
+  pool.destroy();
+  return passed;
+}
+
+int main(int argc, char **argv) {
+  bool passed = check_capacity_for(1);
+  for (uint32_t capacity : {1u << 20, 70020u, 4097u, 1000003u})
+    passed = stress_tlsf(capacity, capacity) && passed;
+
+  if (!has_flag(argc, argv, "--headless")) {
+    std::cout << "BufferPool not checked, it needs --headless" << std::endl;
+    return passed ? 0 : 1;
+  }
+  Platform platform;
+  if (!platform.init(argc, argv, 64, 64, "buffer_pool_test"))
+    return 1;
+  for (size_t page_size : {(size_t)64 << 10, (size_t)70020, (size_t)4097, (size_t)1})
+    passed = stress_pool(page_size, (uint32_t)page_size) && passed;
+  platform.terminate();
+  return passed ? 0 : 1;
+}
@@ -79,6 +79,15 @@ public:
     }
   }
 
+  // a scripted fly-through for reproducible runs (--camera-path): drifts
+  // forward while sweeping left and right and bobbing up and down
+  void follow_path(float time) {
+    pos = glm::vec3(1.5f * sin(0.5f * time), 0.5f * sin(time), 3.0f - time);
+    yaw = -90.0f + 25.0f * sin(0.7f * time);
+    pitch = 10.0f * sin(0.3f * time);
+    on_euler_angle_change();
+  }
+
 private:
   void on_euler_angle_change() {
     glm::vec3 _front;
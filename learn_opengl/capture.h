@@ -0,0 +1,290 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glad/glad.h>
+
+#include "gpu_memory.h"
+#include "stb_image_write.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// non-blocking frame capture
+//
+// capture() queues glReadPixels of the current framebuffer into one pixel
+// pack buffer of a ring and puts a fence behind it. The buffer is mapped only
+// when the ring comes around again, `ring_size` frames later, by which time
+// the copy has long finished and mapping doesn't stall. The mapped pixels are
+// copied out and handed to an encoder thread:
+//
+//   - "out.y4m"             one raw YUV4MPEG2 stream (4:2:0, BT.601), which
+//                           ffmpeg/mpv play directly
+//   - "frames/%05d.png"     one PNG per frame, printf pattern on the index
+//
+// The encoder queue is bounded; when the encoder falls behind capture()
+// blocks instead of dropping frames (counted in `stalls`).
+enum CaptureFormat {
+  CAPTURE_PNG, // one file per frame
+  CAPTURE_Y4M, // one stream
+};
+
+class FrameCapture {
+public:
+  int ring_size = 3;
+  int max_queued = 8; // frames waiting for the encoder
+  long captured = 0;
+  long written = 0;
+  long stalls = 0;
+
+  // the format follows the extension of the path
+  bool open(const char *path, int frame_width, int frame_height) {
+    size_t length = strlen(path);
+    bool y4m = length > 4 && strcmp(path + length - 4, ".y4m") == 0;
+    return open(path, frame_width, frame_height, y4m ? CAPTURE_Y4M : CAPTURE_PNG);
+  }
+
+  // the size is fixed for the whole capture, y4m can't change it midway
+  bool open(const char *path, int frame_width, int frame_height, CaptureFormat capture_format) {
+    close();
+    width = frame_width;
+    height = frame_height;
+    pattern = path;
+    format = capture_format;
+    if (format == CAPTURE_Y4M) {
+      stream = fopen(path, "wb");
+      if (!stream) {
+        std::cout << "ERROR::CAPTURE::OPEN_FAILED: " << path << std::endl;
+        return false;
+      }
+      fprintf(stream, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", width, height);
+    }
+
+    slots.resize(ring_size);
+    for (Slot &slot : slots) {
+      glGenBuffers(1, &slot.buffer);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+      tracked_buffer_data(GL_PIXEL_PACK_BUFFER, slot.buffer, frame_bytes(), NULL, GL_STREAM_READ, "capture");
+      slot.fence = NULL;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    next_slot = 0;
+    captured = written = stalls = 0;
+
+    stopping = false;
+    encoder = std::thread(&FrameCapture::encode_loop, this);
+    return true;
+  }
+
+  bool is_open() const { return !slots.empty(); }
+
+  // start reading back the framebuffer bound for reading; sizes other than
+  // the one given to open() are skipped
+  void capture(int frame_width, int frame_height) {
+    if (!is_open())
+      return;
+    if (frame_width != width || frame_height != height) {
+      if (!size_warned)
+        std::cout << "ERROR::CAPTURE::SIZE_CHANGED: frames of " << frame_width << "x" << frame_height
+                  << " are not captured" << std::endl;
+      size_warned = true;
+      return;
+    }
+
+    Slot &slot = slots[next_slot];
+    if (slot.fence)
+      retire(slot);
+
+    GLint pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.index = captured++;
+    next_slot = (next_slot + 1) % ring_size;
+  }
+
+  // read back what is still in flight, finish encoding and release everything;
+  // needs the context current
+  void close() {
+    if (!is_open())
+      return;
+    for (int i = 0; i < ring_size; i++) {
+      Slot &slot = slots[(next_slot + i) % ring_size];
+      if (slot.fence)
+        retire(slot);
+    }
+    for (Slot &slot : slots) {
+      gpu_memory().release(GPU_BUFFER, slot.buffer);
+      glDeleteBuffers(1, &slot.buffer);
+    }
+    slots.clear();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    condition.notify_all();
+    encoder.join();
+    if (stream)
+      fclose(stream);
+    stream = NULL;
+  }
+
+  const std::string &path() const { return pattern; }
+
+private:
+  struct Slot {
+    unsigned int buffer;
+    GLsync fence;
+    long index;
+  };
+
+  struct Frame {
+    long index;
+    std::vector<unsigned char> pixels; // RGBA, bottom row first
+  };
+
+  int width = 0;
+  int height = 0;
+  std::string pattern;
+  CaptureFormat format = CAPTURE_PNG;
+  FILE *stream = NULL;
+  bool size_warned = false;
+
+  std::vector<Slot> slots;
+  int next_slot = 0;
+
+  std::thread encoder;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Frame> queue;
+  std::vector<std::vector<unsigned char>> spare; // recycled pixel buffers
+  bool stopping = false;
+
+  size_t frame_bytes() const { return (size_t)width * height * 4; }
+
+  void retire(Slot &slot) {
+    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    glDeleteSync(slot.fence);
+    slot.fence = NULL;
+
+    Frame frame;
+    frame.index = slot.index;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if ((int)queue.size() >= max_queued) {
+        stalls++;
+        condition.wait(lock, [this] { return (int)queue.size() < max_queued; });
+      }
+      if (!spare.empty()) {
+        frame.pixels.swap(spare.back());
+        spare.pop_back();
+      }
+    }
+    frame.pixels.resize(frame_bytes());
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes(), GL_MAP_READ_BIT);
+    if (mapped) {
+      memcpy(frame.pixels.data(), mapped, frame_bytes());
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!mapped)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(frame));
+    }
+    condition.notify_all();
+  }
+
+  void encode_loop() {
+    std::vector<unsigned char> converted;
+    for (;;) {
+      Frame frame;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return !queue.empty() || stopping; });
+        if (queue.empty())
+          return;
+        frame = std::move(queue.front());
+        queue.pop_front();
+      }
+      condition.notify_all();
+
+      if (format == CAPTURE_Y4M)
+        write_y4m_frame(frame.pixels, converted);
+      else
+        write_png_frame(frame, converted);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      written++;
+      spare.push_back(std::move(frame.pixels));
+    }
+  }
+
+  void write_png_frame(const Frame &frame, std::vector<unsigned char> &rgb) {
+    rgb.resize((size_t)width * height * 3);
+    for (size_t i = 0, n = (size_t)width * height; i < n; i++)
+      memcpy(&rgb[i * 3], &frame.pixels[i * 4], 3);
+    char path[1024];
+    snprintf(path, sizeof(path), pattern.c_str(), (int)frame.index);
+    // bottom-up rows, glReadPixels order, through a negative stride
+    int stride = width * 3;
+    if (!stbi_write_png(path, width, height, 3, rgb.data() + (size_t)(height - 1) * stride, -stride))
+      std::cout << "ERROR::CAPTURE::PNG_WRITE_FAILED: " << path << std::endl;
+  }
+
+  static unsigned char luma(const unsigned char *pixel) {
+    return (unsigned char)(((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128) >> 8) + 16);
+  }
+
+  // BT.601 studio range, chroma from the average of each 2x2 block; GL rows
+  // are bottom up, y4m top down. Odd edges repeat the last row/column.
+  void write_y4m_frame(const std::vector<unsigned char> &rgba, std::vector<unsigned char> &yuv) {
+    int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    size_t luma_size = (size_t)width * height, chroma_size = (size_t)chroma_width * chroma_height;
+    yuv.resize(luma_size + 2 * chroma_size);
+    unsigned char *y_plane = yuv.data(), *u_plane = y_plane + luma_size, *v_plane = u_plane + chroma_size;
+
+    for (int cy = 0; cy < chroma_height; cy++) {
+      int top = 2 * cy, bottom = top + 1 < height ? top + 1 : top;
+      const unsigned char *row0 = &rgba[(size_t)(height - 1 - top) * width * 4];
+      const unsigned char *row1 = &rgba[(size_t)(height - 1 - bottom) * width * 4];
+      unsigned char *luma0 = y_plane + (size_t)top * width, *luma1 = y_plane + (size_t)bottom * width;
+      unsigned char *u_row = u_plane + (size_t)cy * chroma_width, *v_row = v_plane + (size_t)cy * chroma_width;
+      for (int cx = 0; cx < chroma_width; cx++) {
+        int left = 2 * cx, right = left + 1 < width ? left + 1 : left;
+        const unsigned char *p00 = row0 + left * 4, *p01 = row0 + right * 4;
+        const unsigned char *p10 = row1 + left * 4, *p11 = row1 + right * 4;
+        luma0[left] = luma(p00);
+        luma0[right] = luma(p01);
+        luma1[left] = luma(p10);
+        luma1[right] = luma(p11);
+        // sums of four, the extra shift averages them
+        int r = p00[0] + p01[0] + p10[0] + p11[0];
+        int g = p00[1] + p01[1] + p10[1] + p11[1];
+        int b = p00[2] + p01[2] + p10[2] + p11[2];
+        u_row[cx] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+        v_row[cx] = (unsigned char)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+      }
+    }
+
+    fputs("FRAME\n", stream);
+    fwrite(yuv.data(), 1, yuv.size(), stream);
+  }
+};
+
+#endif // CAPTURE_H
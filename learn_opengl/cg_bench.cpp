@@ -0,0 +1,724 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <benchmark/benchmark.h>
+
+#include "platform.h"
+
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#include "allocation_counter.h"
+
+#include "batch_math.h"
+#include "buffer_pool.h"
+#include "capture.h"
+#include "compact_instance.h"
+#include "job_system.h"
+#include "camera.h"
+#include "culling.h"
+#include "entity_store.h"
+#include "frame_arena.h"
+#include "gl_resource.h"
+#include "instance_transforms.h"
+#include "render_queue.h"
+#include "shader.h"
+#include "transforms.h"
+
+#include "data0.h"
+
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// usage: cg_bench [--benchmark_filter=<regex>] [--benchmark_out=<file.json>]
+//                 [--benchmark_min_time=<seconds>s] [Google Benchmark flags]
+//
+// benchmarks that spread their work over the job system or wait on another
+// thread use real time, CPU time would only count the calling thread
+// runs headless when built with EGL, otherwise in a window; run it from the
+// repository root so the shaders and textures resolve
+
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+const char *VS_PATH = "learn_opengl/shaders/3.6.shader.vs";
+const char *FS_PATH = "learn_opengl/shaders/3.6.shader.fs";
+const char *INSTANCED_VS_PATH = "learn_opengl/shaders/3.6.instanced.vs";
+const char *CONTAINER_PATH = "learn_opengl/textures/container.jpg";
+const char *RAW_CONTAINER_PATH = "cg_bench_container.cgtex";
+
+// n cubes on a grid in front of the camera, each with its own rotation
+std::vector<glm::mat4> scene_models(int64_t n) {
+  std::vector<glm::mat4> models(n);
+  int side = (int)std::ceil(std::cbrt((double)n));
+  for (int64_t i = 0; i < n; i++) {
+    glm::vec3 position(i % side - side / 2.0f, (i / side) % side - side / 2.0f, -(float)(i / (side * side)) - 3.0f);
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position * 2.0f);
+    models[i] = glm::rotate(model, glm::radians(20.0f * i), glm::vec3(1.0f, 0.3f, 0.5f));
+  }
+  return models;
+}
+
+unsigned int create_cube_vao(unsigned int &VBO) {
+  unsigned int VAO;
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  return VAO;
+}
+
+void set_camera_uniforms(Shader &shader) {
+  shader.use();
+  shader.set_mat4("projection", glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f));
+  shader.set_mat4("view", glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+// shaders
+// ------------------------------------------------------------------------
+void BM_ShaderConstruction(benchmark::State &state) {
+  for (auto _ : state) {
+    Shader shader(VS_PATH, FS_PATH);
+    glDeleteProgram(shader.id);
+  }
+}
+BENCHMARK(BM_ShaderConstruction);
+
+// Shader::set_mat4 looks the location up by name on every call
+void BM_SetMat4ByName(benchmark::State &state) {
+  Shader shader(VS_PATH, FS_PATH);
+  shader.use();
+  glm::mat4 model(1.0f);
+  for (auto _ : state) {
+    for (int64_t i = 0; i < state.range(0); i++)
+      shader.set_mat4("model", model);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_SetMat4ByName)->Arg(1000);
+
+void BM_SetMat4CachedLocation(benchmark::State &state) {
+  Shader shader(VS_PATH, FS_PATH);
+  shader.use();
+  int location = glGetUniformLocation(shader.id, "model");
+  glm::mat4 model(1.0f);
+  for (auto _ : state) {
+    for (int64_t i = 0; i < state.range(0); i++)
+      glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(model));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_SetMat4CachedLocation)->Arg(1000);
+
+// textures, glFinish so the upload is part of the measurement
+// ------------------------------------------------------------------------
+void BM_LoadTexture(benchmark::State &state) {
+  for (auto _ : state) {
+    unsigned int texture = load_texture(CONTAINER_PATH, GL_RGB, false);
+    glFinish();
+    glDeleteTextures(1, &texture);
+  }
+}
+BENCHMARK(BM_LoadTexture);
+
+void BM_LoadRawTexture(benchmark::State &state) {
+  Image image;
+  if (!load_image(CONTAINER_PATH, false, 3, image) ||
+      !write_raw_texture(RAW_CONTAINER_PATH, image.pixels.data(), image.width, image.height, image.channels)) {
+    state.SkipWithError(("failed to bake " + std::string(RAW_CONTAINER_PATH)).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    unsigned int texture = load_raw_texture(RAW_CONTAINER_PATH);
+    glFinish();
+    glDeleteTextures(1, &texture);
+  }
+  remove(RAW_CONTAINER_PATH);
+}
+BENCHMARK(BM_LoadRawTexture);
+
+// camera
+// ------------------------------------------------------------------------
+void BM_CameraUpdate(benchmark::State &state) {
+  Camera camera;
+  glm::mat4 view(1.0f);
+  for (auto _ : state) {
+    camera.on_mouse_move(0.5f, -0.25f);
+    camera.on_keyboard_move(FORWARD, 1.0f / 60.0f);
+    camera.on_keyboard_move(LEFT, 1.0f / 60.0f);
+    view = camera.get_view();
+  }
+  state.counters["view_checksum"] = view[3][0];
+}
+BENCHMARK(BM_CameraUpdate);
+
+// draw submission, one frame per iteration; waiting for the GPU is excluded so
+// the numbers are CPU submission cost
+// ------------------------------------------------------------------------
+
+// what hello_camera does: a model matrix uniform and a draw call per cube
+void BM_DrawPerCube(benchmark::State &state) {
+  Shader shader(VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  std::vector<glm::mat4> models = scene_models(state.range(0));
+
+  glEnable(GL_DEPTH_TEST);
+  for (auto _ : state) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for (const glm::mat4 &model : models) {
+      shader.set_mat4("model", model);
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    state.PauseTiming();
+    glFinish();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_DrawPerCube)->RangeMultiplier(10)->Range(10, 10000); // hello_camera draws 10
+
+// per-instance model matrices streamed into a buffer, one draw for the scene
+void BM_DrawInstanced(benchmark::State &state) {
+  Shader shader(INSTANCED_VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  std::vector<glm::mat4> models = scene_models(state.range(0));
+
+  unsigned int instance_buffer;
+  glGenBuffers(1, &instance_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+  for (int column = 0; column < 4; column++) {
+    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void *)(column * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(2 + column);
+    glVertexAttribDivisor(2 + column, 1);
+  }
+
+  glEnable(GL_DEPTH_TEST);
+  for (auto _ : state) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW); // orphan
+    glBufferSubData(GL_ARRAY_BUFFER, 0, models.size() * sizeof(glm::mat4), models.data());
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)models.size());
+    state.PauseTiming();
+    glFinish();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &instance_buffer);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_DrawInstanced)->RangeMultiplier(10)->Range(10, 10000);
+
+// hello_camera's draws recorded into a RenderQueue with two materials
+// interleaved, sorted and submitted; counters are per frame, heap_allocations
+// should stay 0
+void BM_RenderQueue(benchmark::State &state) {
+  Shader shader(VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  std::vector<glm::mat4> models = scene_models(state.range(0));
+  unsigned int textures[2];
+  glGenTextures(2, textures);
+  for (unsigned int texture : textures) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    allocate_texture_storage(GL_TEXTURE_2D, 1, GL_RGBA8, 4, 4);
+  }
+  unsigned int materials[][2] = {{textures[0], textures[1]}, {textures[1], textures[0]}};
+
+  RenderQueue queue;
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f);
+  glEnable(GL_DEPTH_TEST);
+  auto frame = [&]() {
+    next_arena_frame();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    queue.begin_frame(view, projection);
+    for (size_t i = 0; i < models.size(); i++)
+      queue.draw(0, shader.id, VAO, materials[i % 2], 2, GL_TRIANGLES, 0, 36, models[i]);
+    queue.submit();
+  };
+  frame(); // grows the queue's arrays, so the loop measures the steady state
+  size_t allocations = allocation_count();
+  for (auto _ : state) {
+    frame();
+    state.PauseTiming();
+    glFinish();
+    state.ResumeTiming();
+  }
+  allocations = allocation_count() - allocations;
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["state_changes_recorded"] = queue.recorded.state_changes();
+  state.counters["state_changes_submitted"] = queue.submitted.state_changes();
+  state.counters["heap_allocations"] = (double)allocations / state.iterations();
+
+  glDeleteTextures(2, textures);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_RenderQueue)->RangeMultiplier(10)->Range(10, 10000);
+
+// world matrices of range(0) instances on range(1) threads (0 = all cores),
+// transforms.h; items are matrices
+// ------------------------------------------------------------------------
+void BM_TransformUpdate(benchmark::State &state) {
+  size_t count = (size_t)state.range(0);
+  JobSystem jobs(state.range(1) > 0 ? (int)state.range(1) - 1 : -1);
+  std::vector<glm::vec3> positions(count);
+  std::vector<float> angles(count);
+  for (size_t i = 0; i < count; i++) {
+    positions[i] = glm::vec3(i % 100, (i / 100) % 100, i / 10000);
+    angles[i] = 0.1f * i;
+  }
+  std::vector<glm::mat4> models(count);
+  float spin = 0.0f;
+  for (auto _ : state) {
+    update_transforms(jobs, positions.data(), angles.data(), spin, glm::vec3(1.0f, 0.3f, 0.5f), count, models.data());
+    spin += 0.01f;
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t)count);
+  state.counters["threads"] = jobs.thread_count();
+}
+BENCHMARK(BM_TransformUpdate)->Args({10000, 1})->Args({1000000, 1})->Args({10000, 0})->Args({1000000, 0})->UseRealTime();
+
+// frustum culling and packing of the visible world matrices for range(0)
+// entities of an EntityStore on all cores, the per-frame work of
+// hello_instancing; items are entities, heap_allocations is per frame
+// ------------------------------------------------------------------------
+void BM_CullAndPack(benchmark::State &state) {
+  size_t count = (size_t)state.range(0);
+  JobSystem jobs;
+  EntityStore store;
+  store.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    EntityDesc entity;
+    entity.position = glm::vec3(i % 100, (i / 100) % 100, i / 10000) * 2.0f - glm::vec3(100.0f);
+    entity.rotation = axis_angle(glm::vec3(1.0f, 0.3f, 0.5f), 0.1f * i);
+    store.add(entity);
+  }
+  glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f) *
+                              glm::lookAt(glm::vec3(0.0f, 0.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  std::vector<glm::mat4> models(count);
+  size_t visible = 0, allocations = allocation_count();
+  for (auto _ : state) {
+    next_arena_frame();
+    visible = cull_entities(jobs, store, view_projection);
+    write_visible_transforms(jobs, store, 0, models.data());
+  }
+  allocations = allocation_count() - allocations;
+  state.SetItemsProcessed(state.iterations() * (int64_t)count);
+  state.counters["visible"] = (double)visible;
+  state.counters["heap_allocations"] = (double)allocations / state.iterations();
+}
+BENCHMARK(BM_CullAndPack)->Arg(10000)->Arg(1000000)->UseRealTime();
+
+// view-projection * world of 100000 entities on one core: the glm
+// translate/rotate/multiply chain the demos used against batch_math.h's
+// kernels, range(0) = -1 for glm or a BatchMathPath; items are matrices and
+// max_error is the largest difference to glm's result
+// ------------------------------------------------------------------------
+void BM_BatchMvp(benchmark::State &state) {
+  const size_t count = 100000;
+  const glm::vec3 axis(1.0f, 0.3f, 0.5f);
+  EntityStore store;
+  store.reserve(count);
+  std::vector<float> angles(count);
+  for (size_t i = 0; i < count; i++) {
+    EntityDesc entity;
+    entity.position = glm::vec3(i % 100, (i / 100) % 100, i / 10000);
+    angles[i] = 0.1f * i;
+    entity.rotation = axis_angle(axis, angles[i]);
+    store.add(entity);
+  }
+  glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f) *
+                              glm::lookAt(glm::vec3(0.0f, 0.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  auto glm_mvp = [&](size_t i) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), store.position(i));
+    return view_projection * glm::rotate(model, angles[i], axis);
+  };
+
+  int path = (int)state.range(0);
+  if (path >= 0 && !batch_path_supported((BatchMathPath)path)) {
+    state.SkipWithError((std::string(batch_path_name((BatchMathPath)path)) + " not supported").c_str());
+    return;
+  }
+  std::vector<glm::mat4> out(count);
+  for (auto _ : state) {
+    if (path < 0)
+      for (size_t i = 0; i < count; i++)
+        out[i] = glm_mvp(i);
+    else
+      batch_mvp_matrices(store, 0, count, view_projection, out.data(), (BatchMathPath)path);
+  }
+
+  float max_error = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    glm::mat4 expected = glm_mvp(i);
+    for (int column = 0; column < 4; column++)
+      for (int row = 0; row < 4; row++)
+        max_error = std::max(max_error, std::fabs(out[i][column][row] - expected[column][row]));
+  }
+  state.SetLabel(path < 0 ? "glm" : batch_path_name((BatchMathPath)path));
+  state.SetItemsProcessed(state.iterations() * (int64_t)count);
+  state.counters["max_error"] = max_error;
+}
+BENCHMARK(BM_BatchMvp)->Arg(-1)->Arg(BATCH_SCALAR)->Arg(BATCH_SSE)->Arg(BATCH_AVX2);
+
+// per-frame InstanceTransforms::update() for 100000 instances of which
+// range(0) percent are dynamic; the static ones were uploaded before the
+// timing starts, so the cost should follow the dynamic share. Items are
+// instances, dynamic or not
+// ------------------------------------------------------------------------
+void BM_InstanceUpdate(benchmark::State &state) {
+  const size_t count = 100000;
+  size_t dynamic_count = count * (size_t)state.range(0) / 100;
+  InstanceTransforms transforms;
+  transforms.init();
+  for (size_t i = 0; i < count; i++) {
+    EntityDesc entity;
+    entity.position = glm::vec3(i % 100, (i / 100) % 100, i / 10000);
+    entity.rotation = axis_angle(glm::vec3(1.0f, 0.3f, 0.5f), 0.1f * i);
+    transforms.add(entity, i < dynamic_count);
+  }
+  transforms.update();
+  glFinish();
+
+  for (auto _ : state)
+    transforms.update();
+  glFinish();
+  transforms.destroy();
+  gl_delete_queue().flush();
+  state.SetItemsProcessed(state.iterations() * (int64_t)count);
+  state.counters["computed"] = (double)transforms.last_computed;
+}
+BENCHMARK(BM_InstanceUpdate)->Arg(0)->Arg(1)->Arg(10)->Arg(100);
+
+// 1M instances packed on all cores into a mapped stream buffer as mat4
+// (range(0) = 0) or CompactInstance (1); range(1) = 1 also draws them into
+// a 64x64 viewport and waits for the GPU, so the vertex shader's expansion
+// is part of the cost. Items are instances
+// ------------------------------------------------------------------------
+void BM_CompactInstancing(benchmark::State &state) {
+  const size_t count = 1000000;
+  bool compact = state.range(0) != 0, draw = state.range(1) != 0;
+  size_t instance_size = compact ? sizeof(CompactInstance) : sizeof(glm::mat4);
+  JobSystem jobs;
+  EntityStore store;
+  store.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    EntityDesc entity;
+    entity.position = glm::vec3(i % 100, (i / 100) % 100, i / 10000) * 2.0f - glm::vec3(100.0f);
+    entity.rotation = axis_angle(glm::vec3(1.0f, 0.3f, 0.5f), 0.1f * i);
+    store.add(entity);
+  }
+
+  Shader shader(compact ? "learn_opengl/shaders/3.6.compact.vs" : INSTANCED_VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  unsigned int instance_buffer;
+  glGenBuffers(1, &instance_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, count * instance_size, NULL, GL_STREAM_DRAW);
+  if (compact) {
+    compact_instance_attributes(0);
+  } else {
+    for (int column = 0; column < 4; column++) {
+      glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(column * sizeof(glm::vec4)));
+      glEnableVertexAttribArray(2 + column);
+      glVertexAttribDivisor(2 + column, 1);
+    }
+  }
+  glViewport(0, 0, 64, 64);
+  glEnable(GL_DEPTH_TEST);
+
+  for (auto _ : state) {
+    next_arena_frame();
+    void *instances =
+        glMapBufferRange(GL_ARRAY_BUFFER, 0, count * instance_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (compact)
+      write_visible_compact(jobs, store, 0, (CompactInstance *)instances);
+    else
+      write_visible_transforms(jobs, store, 0, (glm::mat4 *)instances);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    if (draw) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)count);
+    }
+    glFinish();
+  }
+  state.SetItemsProcessed(state.iterations() * (int64_t)count);
+  state.counters["bytes_per_instance"] = (double)instance_size;
+
+  glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &instance_buffer);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_CompactInstancing)->Args({0, 0})->Args({1, 0})->Args({0, 1})->Args({1, 1})->UseRealTime();
+
+// frame capture at 1080p: a full frame (GPU work included) with no capture,
+// a blocking glReadPixels, and capture.h's PBO ring with the encoder thread
+// writing a y4m stream to the null device
+// ------------------------------------------------------------------------
+enum CaptureMode { CAPTURE_NONE, CAPTURE_SYNC, CAPTURE_ASYNC };
+
+void BM_Capture1080p(benchmark::State &state) {
+  const int width = 1920, height = 1080;
+  unsigned int color_buffer, depth_buffer, framebuffer;
+  glGenRenderbuffers(1, &color_buffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depth_buffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+  glViewport(0, 0, width, height);
+
+  Shader shader(VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  std::vector<glm::mat4> models = scene_models(100);
+  std::vector<unsigned char> pixels((size_t)width * height * 4);
+  FrameCapture capture;
+  CaptureMode mode = (CaptureMode)state.range(0);
+#ifdef _WIN32
+  const char *null_device = "NUL";
+#else
+  const char *null_device = "/dev/null";
+#endif
+  if (mode == CAPTURE_ASYNC)
+    capture.open(null_device, width, height, CAPTURE_Y4M);
+
+  glEnable(GL_DEPTH_TEST);
+  for (auto _ : state) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for (const glm::mat4 &model : models) {
+      shader.set_mat4("model", model);
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+    if (mode == CAPTURE_SYNC)
+      glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    else if (mode == CAPTURE_ASYNC)
+      capture.capture(width, height);
+    glFinish(); // stands in for the swap
+  }
+  state.SetLabel(mode == CAPTURE_NONE ? "none" : mode == CAPTURE_SYNC ? "glReadPixels" : "pbo ring");
+  capture.close();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteRenderbuffers(1, &color_buffer);
+  glDeleteRenderbuffers(1, &depth_buffer);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_Capture1080p)->Arg(CAPTURE_NONE)->Arg(CAPTURE_SYNC)->Arg(CAPTURE_ASYNC)->UseRealTime();
+
+// 16 transient vertex buffers of 256 KiB per frame, each filled and drawn
+// from once, then dropped: created and deleted on the spot (0), or retired
+// into gl_delete_queue() and recycled with take_buffer() once their fence
+// has signalled (1). Items are buffers
+// ------------------------------------------------------------------------
+void BM_TransientBuffers(benchmark::State &state) {
+  const int per_frame = 16;
+  const size_t bytes = 256 * 1024;
+  bool recycle = state.range(0) != 0;
+  Shader shader(VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  shader.set_mat4("model", glm::mat4(1.0f));
+  unsigned int VBO, VAO = create_cube_vao(VBO);
+  std::vector<unsigned char> data(bytes);
+  memcpy(data.data(), cube_vertices, sizeof(cube_vertices));
+
+  long deleted = gl_delete_queue().deleted, recycled = gl_delete_queue().recycled;
+  for (auto _ : state) {
+    for (int i = 0; i < per_frame; i++) {
+      GlBuffer buffer;
+      if (recycle)
+        buffer = GlBuffer::adopt(gl_delete_queue().take_buffer(bytes, GL_STREAM_DRAW, "bench"));
+      if (buffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.name());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.data());
+      } else {
+        buffer = GlBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.name());
+        tracked_buffer_data(GL_ARRAY_BUFFER, buffer.name(), bytes, data.data(), GL_STREAM_DRAW, "bench");
+      }
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+      if (!recycle) {
+        unsigned int name = buffer.release();
+        gpu_memory().release(GPU_BUFFER, name);
+        glDeleteBuffers(1, &name);
+      }
+    }
+    glFlush(); // stands in for the swap
+    gl_delete_queue().next_frame();
+  }
+  state.SetItemsProcessed(state.iterations() * per_frame);
+  state.SetLabel(recycle ? "recycled" : "create/delete");
+  state.counters["recycled"] = (double)(gl_delete_queue().recycled - recycled);
+  state.counters["deleted"] = (double)(gl_delete_queue().deleted - deleted);
+  gl_delete_queue().flush();
+
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_TransientBuffers)->Arg(0)->Arg(1);
+
+// 256 different indexed meshes drawn once each per frame: every mesh with
+// its own VAO, VBO and EBO (0), or all of them in one BufferPool page behind
+// a single VAO, drawn with glDrawElementsBaseVertex (1). Items are draws
+// ------------------------------------------------------------------------
+void BM_MeshBatching(benchmark::State &state) {
+  const int mesh_count = 256;
+  const size_t stride = 5 * sizeof(float);
+  bool pooled = state.range(0) != 0;
+  Shader shader(VS_PATH, FS_PATH);
+  set_camera_uniforms(shader);
+  std::vector<glm::mat4> models = scene_models(mesh_count);
+
+  unsigned int indices[36];
+  for (int i = 0; i < 36; i++)
+    indices[i] = i;
+  std::vector<std::vector<float>> meshes(mesh_count);
+  for (int m = 0; m < mesh_count; m++) {
+    meshes[m].assign(cube_vertices, cube_vertices + sizeof(cube_vertices) / sizeof(float));
+    for (size_t v = 0; v < meshes[m].size(); v += 5)
+      for (int axis = 0; axis < 3; axis++)
+        meshes[m][v + axis] *= 0.5f + 0.1f * (m % 8);
+  }
+
+  std::vector<unsigned int> vaos(mesh_count), vbos(mesh_count), ebos(mesh_count);
+  BufferPool pool;
+  std::vector<BufferRange> vertices(mesh_count), elements(mesh_count);
+  if (pooled) {
+    pool.init(1 << 20, GL_STATIC_DRAW, "bench");
+    for (int m = 0; m < mesh_count; m++) {
+      vertices[m] = pool.allocate(meshes[m].size() * sizeof(float), stride, meshes[m].data());
+      elements[m] = pool.allocate(sizeof(indices), sizeof(unsigned int), indices);
+    }
+    glGenVertexArrays(1, &vaos[0]);
+    glBindVertexArray(vaos[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.buffer(vertices[0]));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.buffer(elements[0]));
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)(0));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+  } else {
+    glGenVertexArrays(mesh_count, vaos.data());
+    glGenBuffers(mesh_count, vbos.data());
+    glGenBuffers(mesh_count, ebos.data());
+    for (int m = 0; m < mesh_count; m++) {
+      glBindVertexArray(vaos[m]);
+      glBindBuffer(GL_ARRAY_BUFFER, vbos[m]);
+      glBufferData(GL_ARRAY_BUFFER, meshes[m].size() * sizeof(float), meshes[m].data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebos[m]);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)(0));
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+      glEnableVertexAttribArray(1);
+    }
+  }
+
+  glEnable(GL_DEPTH_TEST);
+  for (auto _ : state) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (pooled)
+      glBindVertexArray(vaos[0]);
+    for (int m = 0; m < mesh_count; m++) {
+      shader.set_mat4("model", models[m]);
+      if (pooled) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)pool.offset(elements[m]),
+                                 (GLint)(pool.offset(vertices[m]) / stride));
+      } else {
+        glBindVertexArray(vaos[m]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
+      }
+    }
+    state.PauseTiming();
+    glFinish();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * mesh_count);
+  state.SetLabel(pooled ? "pool + base vertex" : "buffers per mesh");
+  state.counters["buffers"] = pooled ? (double)pool.buffer_count() : 2.0 * mesh_count;
+
+  glBindVertexArray(0);
+  if (pooled) {
+    glDeleteVertexArrays(1, &vaos[0]);
+    pool.destroy();
+    gl_delete_queue().flush();
+  } else {
+    glDeleteVertexArrays(mesh_count, vaos.data());
+    glDeleteBuffers(mesh_count, vbos.data());
+    glDeleteBuffers(mesh_count, ebos.data());
+  }
+  glDeleteProgram(shader.id);
+}
+BENCHMARK(BM_MeshBatching)->Arg(0)->Arg(1);
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+
+  // always headless when possible, benchmarks shouldn't depend on a compositor
+  std::vector<char *> platform_args = {argv[0]};
+#ifdef CG_HAS_EGL
+  char headless[] = "--headless";
+  platform_args.push_back(headless);
+#endif
+  Platform platform;
+  if (!platform.init((int)platform_args.size(), platform_args.data(), SCR_WIDTH, SCR_HEIGHT, "cg_bench"))
+    return -1;
+
+  benchmark::AddCustomContext("gl_renderer", (const char *)glGetString(GL_RENDERER));
+  benchmark::AddCustomContext("gl_version", (const char *)glGetString(GL_VERSION));
+  benchmark::AddCustomContext("headless", platform.headless() ? "true" : "false");
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef COMPACT_INSTANCE_H
+#define COMPACT_INSTANCE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "entity_store.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// an instance as position, uniform scale and rotation, 24 bytes against a
+// mat4's 64; shaders/3.6.compact.vs expands it to the world transform
+struct CompactInstance {
+  float position[3];
+  float scale;
+  int16_t rotation[4]; // unit quaternion x, y, z, w as snorm16
+};
+static_assert(sizeof(CompactInstance) == 24, "CompactInstance must stay tightly packed");
+
+// round to nearest, GL decodes c as max(c / 32767, -1)
+inline int16_t to_snorm16(float value) {
+  value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+  return (int16_t)(value * 32767.0f + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+inline CompactInstance compact_instance(const EntityStore &store, size_t i) {
+  CompactInstance instance;
+  instance.position[0] = store.position_x[i];
+  instance.position[1] = store.position_y[i];
+  instance.position[2] = store.position_z[i];
+  instance.scale = store.scale[i];
+  instance.rotation[0] = to_snorm16(store.rotation_x[i]);
+  instance.rotation[1] = to_snorm16(store.rotation_y[i]);
+  instance.rotation[2] = to_snorm16(store.rotation_z[i]);
+  instance.rotation[3] = to_snorm16(store.rotation_w[i]);
+  return instance;
+}
+
+// point attributes 2 (position and scale) and 3 (rotation) of the bound
+// vertex array at the compact instances from byte `offset` of the bound
+// GL_ARRAY_BUFFER, one per instance
+inline void compact_instance_attributes(size_t offset) {
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(CompactInstance),
+                        (void *)(offset + offsetof(CompactInstance, position)));
+  glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, sizeof(CompactInstance),
+                        (void *)(offset + offsetof(CompactInstance, rotation)));
+  for (int location = 2; location < 4; location++) {
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+}
+
+#endif // COMPACT_INSTANCE_H
@@ -0,0 +1,64 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "entity_store.h"
+#include "job_system.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+
+// the six planes of a view frustum, pointing inwards, from a view-projection
+// matrix (Gribb/Hartmann)
+struct Frustum {
+  glm::vec4 planes[6];
+
+  explicit Frustum(const glm::mat4 &view_projection) {
+    for (int axis = 0; axis < 3; axis++) {
+      for (int side = 0; side < 2; side++) {
+        glm::vec4 &plane = planes[axis * 2 + side];
+        for (int column = 0; column < 4; column++) {
+          float row = view_projection[column][axis];
+          plane[column] = view_projection[column][3] + (side == 0 ? row : -row);
+        }
+        plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+      }
+    }
+  }
+};
+
+// entities per culling job, a multiple of 64 so no two jobs share a word of
+// visibility bits
+const size_t CULL_GRAIN = 4096;
+
+// set the visibility bit of every entity whose bounding sphere touches the
+// frustum, returns how many do
+inline size_t cull_entities(JobSystem &jobs, EntityStore &store, const glm::mat4 &view_projection) {
+  Frustum frustum(view_projection);
+  std::atomic<size_t> visible_count(0);
+  jobs.parallel_for(store.size(), CULL_GRAIN, [&](size_t begin, size_t end) {
+    const float *x = store.position_x.data(), *y = store.position_y.data(), *z = store.position_z.data();
+    const float *radius = store.radius.data(), *scale = store.scale.data();
+    size_t count = 0;
+    for (size_t word = begin / 64; word * 64 < end; word++) {
+      uint64_t bits = 0;
+      size_t word_end = word * 64 + 64 < end ? word * 64 + 64 : end;
+      for (size_t i = word * 64; i < word_end; i++) {
+        float r = radius[i] * std::fabs(scale[i]);
+        bool inside = true;
+        for (const glm::vec4 &plane : frustum.planes)
+          inside &= plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w >= -r;
+        bits |= (uint64_t)inside << (i % 64);
+      }
+      store.visible[word] = bits;
+      for (uint64_t rest = bits; rest; rest &= rest - 1)
+        count++;
+    }
+    visible_count += count;
+  });
+  return visible_count;
+}
+
+#endif // CULLING_H
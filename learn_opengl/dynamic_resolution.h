@@ -0,0 +1,292 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "gpu_memory.h"
+#include "shader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+enum UpscaleFilter {
+  UPSCALE_BILINEAR, // glBlitFramebuffer with GL_LINEAR
+  UPSCALE_SHARPEN,  // bilinear plus contrast adaptive sharpening, shaders/3.9.upscale.*
+};
+
+// command line switches of the dynamic resolution
+//
+//   --res-scale MIN:MAX           bounds of the render scale (default 0.5:1)
+//   --gpu-budget MS               GPU time to aim for, 0 keeps MAX (default)
+//   --upscale bilinear|sharpen    how the frame is scaled to the window
+struct ResolutionOptions {
+  float min_scale = 0.5f;
+  float max_scale = 1.0f;
+  double gpu_budget = 0.0; // ms
+  UpscaleFilter filter = UPSCALE_BILINEAR;
+};
+
+inline ResolutionOptions parse_resolution_options(int argc, char **argv) {
+  ResolutionOptions options;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--res-scale") == 0) {
+      if (sscanf(argv[++i], "%f:%f", &options.min_scale, &options.max_scale) != 2)
+        std::cout << "ERROR::RESOLUTION::BAD_SCALE: " << argv[i] << std::endl;
+    } else if (strcmp(argv[i], "--gpu-budget") == 0) {
+      options.gpu_budget = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--upscale") == 0) {
+      const char *filter = argv[++i];
+      if (strcmp(filter, "bilinear") == 0)
+        options.filter = UPSCALE_BILINEAR;
+      else if (strcmp(filter, "sharpen") == 0)
+        options.filter = UPSCALE_SHARPEN;
+      else
+        std::cout << "ERROR::RESOLUTION::UNKNOWN_FILTER: " << filter << std::endl;
+    }
+  }
+  if (options.max_scale <= 0.0f)
+    options.max_scale = 1.0f;
+  if (options.min_scale <= 0.0f || options.min_scale > options.max_scale)
+    options.min_scale = options.max_scale;
+  return options;
+}
+
+// renders the scene at a fraction of the output size and scales it up
+//
+//   resolution.begin_frame();      // binds the low resolution target
+//   ... clear, draw ...
+//   resolution.end_frame(platform.framebuffer);
+//
+// The target is allocated once at max_scale times the output and a frame only
+// uses its lower left corner, so changing the scale never reallocates; only
+// resize() (the window changed) does.
+//
+// With a GPU budget the scale follows the GPU time of the frames, measured
+// with a pair of GL_TIMESTAMP queries read a few frames later without
+// waiting. Unlike GL_TIME_ELAPSED they can't collide with another timer
+// query, such as the profiler's frame query, which is active at the same time. Fill
+// cost goes with the pixel count, so the scale moves by the square root of
+// budget / time, aiming a little below the budget. Small corrections are
+// ignored and after a change the frames still in flight are not used, which
+// keeps the scale from oscillating.
+class DynamicResolution {
+public:
+  static const int QUERIES = 3;
+
+  ResolutionOptions options;
+  float scale = 1.0f;
+  int width = 0; // output size
+  int height = 0;
+  double gpu_time = 0.0; // smoothed ms of the scene, 0 until measured
+
+  bool init(const ResolutionOptions &resolution_options, int output_width, int output_height) {
+    options = resolution_options;
+    scale = options.max_scale;
+    glGenFramebuffers(1, &framebuffer);
+    glGenQueries(2 * QUERIES, &queries[0][0]);
+    if (options.filter == UPSCALE_SHARPEN) {
+      shader = new Shader("learn_opengl/shaders/3.9.upscale.vs", "learn_opengl/shaders/3.9.upscale.fs");
+      glGenVertexArrays(1, &empty_vao);
+    }
+    return resize(output_width, output_height);
+  }
+
+  // reallocate for a new output size, e.g. from framebuffer_size_callback
+  bool resize(int output_width, int output_height) {
+    width = output_width > 1 ? output_width : 1;
+    height = output_height > 1 ? output_height : 1;
+    int target_width = (int)std::ceil(width * options.max_scale);
+    int target_height = (int)std::ceil(height * options.max_scale);
+
+    GLint texture_binding, renderbuffer_binding, framebuffer_binding;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture_binding);
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer_binding);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer_binding);
+
+    if (color_texture) {
+      gpu_memory().release(GPU_TEXTURE, color_texture);
+      glDeleteTextures(1, &color_texture);
+    }
+    glGenTextures(1, &color_texture);
+    glBindTexture(GL_TEXTURE_2D, color_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, target_width, target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    gpu_memory().track_texture(color_texture, GL_RGBA8, target_width, target_height, 1, 1, "render target");
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (depth_buffer) {
+      gpu_memory().release(GPU_RENDERBUFFER, depth_buffer);
+      glDeleteRenderbuffers(1, &depth_buffer);
+    }
+    glGenRenderbuffers(1, &depth_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, target_width, target_height);
+    gpu_memory().track_renderbuffer(depth_buffer, GL_DEPTH24_STENCIL8, target_width, target_height, "render target");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete)
+      std::cout << "ERROR::RESOLUTION::FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_binding);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer_binding);
+    glBindTexture(GL_TEXTURE_2D, texture_binding);
+    texture_width = target_width;
+    texture_height = target_height;
+    return complete;
+  }
+
+  int render_width() const { return clamp_size((int)(width * scale + 0.5f), texture_width); }
+  int render_height() const { return clamp_size((int)(height * scale + 0.5f), texture_height); }
+  float aspect() const { return (float)width / height; }
+
+  // adjust the scale from finished queries, then bind the target
+  void begin_frame() {
+    collect_queries();
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, render_width(), render_height());
+    if (!query_active[next_query]) {
+      glQueryCounter(queries[next_query][0], GL_TIMESTAMP);
+      query_active[next_query] = true;
+      query_scale[next_query] = scale;
+      timing = true;
+    }
+  }
+
+  // scale the frame up into `target`, which stays bound with a full viewport
+  void end_frame(unsigned int target) {
+    if (timing) {
+      glQueryCounter(queries[next_query][1], GL_TIMESTAMP);
+      next_query = (next_query + 1) % QUERIES;
+      timing = false;
+    }
+
+    if (options.filter == UPSCALE_SHARPEN && shader)
+      upscale_sharpen(target);
+    else
+      upscale_bilinear(target);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, width, height);
+  }
+
+  // call while the context is still current
+  void destroy() {
+    gpu_memory().release(GPU_TEXTURE, color_texture);
+    gpu_memory().release(GPU_RENDERBUFFER, depth_buffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &color_texture);
+    glDeleteRenderbuffers(1, &depth_buffer);
+    glDeleteQueries(2 * QUERIES, &queries[0][0]);
+    framebuffer = color_texture = depth_buffer = 0;
+    if (shader) {
+      glDeleteProgram(shader->id);
+      glDeleteVertexArrays(1, &empty_vao);
+      delete shader;
+      shader = NULL;
+    }
+  }
+
+private:
+  unsigned int framebuffer = 0;
+  unsigned int color_texture = 0;
+  unsigned int depth_buffer = 0;
+  int texture_width = 0;
+  int texture_height = 0;
+
+  unsigned int queries[QUERIES][2] = {}; // GL_TIMESTAMP at begin_frame() and end_frame()
+  bool query_active[QUERIES] = {};
+  float query_scale[QUERIES] = {};
+  int next_query = 0;
+  bool timing = false;
+  long samples = 0;
+
+  Shader *shader = NULL;
+  unsigned int empty_vao = 0;
+
+  static int clamp_size(int size, int limit) { return size < 1 ? 1 : size > limit ? limit : size; }
+
+  void collect_queries() {
+    for (int i = 0; i < QUERIES; i++) {
+      int index = (next_query + i) % QUERIES; // oldest first
+      if (!query_active[index])
+        continue;
+      GLint available = 0;
+      // the end timestamp comes last, when it is there so is the begin one
+      glGetQueryObjectiv(queries[index][1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        break;
+      GLuint64 begin = 0, end = 0;
+      glGetQueryObjectui64v(queries[index][0], GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(queries[index][1], GL_QUERY_RESULT, &end);
+      GLuint64 elapsed = end > begin ? end - begin : 0;
+      query_active[index] = false;
+      // the first result of a fresh context includes its start up, and frames
+      // rendered at an older scale say nothing about the current one
+      if (samples++ == 0 || query_scale[index] != scale)
+        continue;
+      double ms = elapsed / 1.0e6;
+      gpu_time = gpu_time == 0.0 ? ms : 0.8 * gpu_time + 0.2 * ms;
+      adjust_scale();
+    }
+  }
+
+  void adjust_scale() {
+    if (options.gpu_budget <= 0.0 || gpu_time <= 0.0)
+      return;
+    float target = scale * (float)std::sqrt(0.9 * options.gpu_budget / gpu_time);
+    target = target < options.min_scale ? options.min_scale : target > options.max_scale ? options.max_scale : target;
+    if (std::fabs(target - scale) < 0.02f)
+      return;
+    scale = target;
+  }
+
+  void upscale_bilinear(unsigned int target) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, render_width(), render_height(), 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                      GL_LINEAR);
+  }
+
+  // a full screen pass; the state it touches is put back for the caller
+  void upscale_sharpen(unsigned int target) {
+    GLint program, vao, active_texture, texture_binding, sampler_binding;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture_binding);
+    glGetIntegerv(GL_SAMPLER_BINDING, &sampler_binding);
+    GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    glBindTexture(GL_TEXTURE_2D, color_texture);
+    glBindSampler(0, 0);
+    shader->use();
+    shader->set_int("source", 0);
+    glUniform2f(glGetUniformLocation(shader->id, "uv_scale"), (float)render_width() / texture_width,
+                (float)render_height() / texture_height);
+    glUniform2f(glGetUniformLocation(shader->id, "texel"), 1.0f / texture_width, 1.0f / texture_height);
+    shader->set_float("sharpness", scale < 1.0f ? 1.0f - scale : 0.25f);
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindVertexArray(vao);
+    glUseProgram(program);
+    glBindSampler(0, sampler_binding);
+    glBindTexture(GL_TEXTURE_2D, texture_binding);
+    glActiveTexture(active_texture);
+    if (depth_test)
+      glEnable(GL_DEPTH_TEST);
+  }
+};
+
+#endif // DYNAMIC_RESOLUTION_H
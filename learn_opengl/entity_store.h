@@ -0,0 +1,167 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// refers to an entity for as long as it lives; stale handles are detected
+struct EntityHandle {
+  uint32_t slot;
+  uint32_t generation;
+};
+
+// what an entity starts with; rotation is a unit quaternion (x, y, z, w)
+struct EntityDesc {
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec4 rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  float scale = 1.0f;
+  float radius = 0.8660254f; // bounding sphere of the unit cube
+  uint32_t material = 0;
+};
+
+// rotation by `angle` radians around `axis` as a quaternion, the same
+// rotation glm::rotate builds
+inline glm::vec4 axis_angle(const glm::vec3 &axis, float angle) {
+  glm::vec3 n = glm::normalize(axis) * std::sin(angle * 0.5f);
+  return glm::vec4(n.x, n.y, n.z, std::cos(angle * 0.5f));
+}
+
+// rotation b followed by rotation a (Hamilton product a * b), both x, y, z, w;
+// rotate(rotate(m, angle_a, axis_a), angle_b, axis_b) rotates by
+// quat_multiply(axis_angle(axis_a, angle_a), axis_angle(axis_b, angle_b))
+inline glm::vec4 quat_multiply(const glm::vec4 &a, const glm::vec4 &b) {
+  return glm::vec4(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y, a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                   a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w, a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+// instances kept as structure of arrays: one tightly packed array per
+// component, so a stage that needs positions and radii touches nothing else
+// and its inner loop vectorizes
+//
+// The arrays are dense, element i of each belongs to the i-th live entity.
+// remove() moves the last entity into the hole (swap and pop), which keeps
+// them dense in O(1) but changes that entity's index; handles go through a
+// slot table and stay valid. Indices are only good until the next remove().
+class EntityStore {
+public:
+  std::vector<float> position_x, position_y, position_z;
+  std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+  std::vector<float> scale;
+  std::vector<float> radius; // local bounding sphere around the position
+  std::vector<uint32_t> material;
+  std::vector<uint64_t> visible; // one bit per entity, written by culling
+
+  size_t size() const { return position_x.size(); }
+
+  void reserve(size_t count) {
+    for_each_float_array([&](std::vector<float> &array) { array.reserve(count); });
+    material.reserve(count);
+    owner.reserve(count);
+    visible.reserve((count + 63) / 64);
+  }
+
+  EntityHandle add(const EntityDesc &desc) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = (uint32_t)slot_index.size();
+      slot_index.push_back(0);
+      slot_generation.push_back(0);
+    }
+    size_t index = size();
+    slot_index[slot] = (uint32_t)index;
+    owner.push_back(slot);
+
+    position_x.push_back(desc.position.x);
+    position_y.push_back(desc.position.y);
+    position_z.push_back(desc.position.z);
+    rotation_x.push_back(desc.rotation.x);
+    rotation_y.push_back(desc.rotation.y);
+    rotation_z.push_back(desc.rotation.z);
+    rotation_w.push_back(desc.rotation.w);
+    scale.push_back(desc.scale);
+    radius.push_back(desc.radius);
+    material.push_back(desc.material);
+    if (index % 64 == 0)
+      visible.push_back(0);
+    set_visible(index, true);
+
+    EntityHandle handle = {slot, slot_generation[slot]};
+    return handle;
+  }
+
+  // false for stale handles
+  bool remove(EntityHandle handle) {
+    if (!alive(handle))
+      return false;
+    size_t index = slot_index[handle.slot], last = size() - 1;
+    if (index != last) {
+      for_each_float_array([&](std::vector<float> &array) { array[index] = array[last]; });
+      material[index] = material[last];
+      set_visible(index, is_visible(last));
+      owner[index] = owner[last];
+      slot_index[owner[index]] = (uint32_t)index;
+    }
+    for_each_float_array([](std::vector<float> &array) { array.pop_back(); });
+    material.pop_back();
+    owner.pop_back();
+    set_visible(last, false);
+    if (last % 64 == 0)
+      visible.pop_back();
+
+    slot_generation[handle.slot]++;
+    free_slots.push_back(handle.slot);
+    return true;
+  }
+
+  bool alive(EntityHandle handle) const {
+    return handle.slot < slot_generation.size() && slot_generation[handle.slot] == handle.generation;
+  }
+
+  // dense index of a live entity
+  size_t index_of(EntityHandle handle) const { return slot_index[handle.slot]; }
+
+  bool is_visible(size_t index) const { return (visible[index / 64] >> (index % 64)) & 1; }
+
+  void set_visible(size_t index, bool value) {
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    visible[index / 64] = value ? visible[index / 64] | bit : visible[index / 64] & ~bit;
+  }
+
+  glm::vec3 position(size_t index) const {
+    return glm::vec3(position_x[index], position_y[index], position_z[index]);
+  }
+
+  // world matrix: translate * rotate * scale
+  glm::mat4 matrix(size_t index) const {
+    float x = rotation_x[index], y = rotation_y[index], z = rotation_z[index], w = rotation_w[index];
+    float s = scale[index];
+    glm::mat4 m;
+    m[0] = glm::vec4(s * (1.0f - 2.0f * (y * y + z * z)), s * 2.0f * (x * y + w * z), s * 2.0f * (x * z - w * y), 0.0f);
+    m[1] = glm::vec4(s * 2.0f * (x * y - w * z), s * (1.0f - 2.0f * (x * x + z * z)), s * 2.0f * (y * z + w * x), 0.0f);
+    m[2] = glm::vec4(s * 2.0f * (x * z + w * y), s * 2.0f * (y * z - w * x), s * (1.0f - 2.0f * (x * x + y * y)), 0.0f);
+    m[3] = glm::vec4(position_x[index], position_y[index], position_z[index], 1.0f);
+    return m;
+  }
+
+private:
+  std::vector<uint32_t> owner;           // dense index -> slot
+  std::vector<uint32_t> slot_index;      // slot -> dense index
+  std::vector<uint32_t> slot_generation; // bumped when the slot's entity goes
+  std::vector<uint32_t> free_slots;
+
+  template <typename Function> void for_each_float_array(const Function &function) {
+    std::vector<float> *arrays[] = {&position_x, &position_y, &position_z, &rotation_x, &rotation_y,
+                                    &rotation_z, &rotation_w, &scale,      &radius};
+    for (std::vector<float> *array : arrays)
+      function(*array);
+  }
+};
+
+#endif // ENTITY_STORE_H
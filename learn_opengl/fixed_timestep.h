@@ -0,0 +1,110 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// command line switches of the simulation clock
+//
+//   --tick-rate HZ   simulation ticks per second (default 60)
+//   --max-ticks N    most ticks run to catch up in one frame (default 5)
+struct TimestepOptions {
+  double tick_rate = 60.0;
+  int max_ticks = 5;
+};
+
+inline TimestepOptions parse_timestep_options(int argc, char **argv) {
+  TimestepOptions options;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--tick-rate") == 0)
+      options.tick_rate = atof(argv[++i]);
+    else if (strcmp(argv[i], "--max-ticks") == 0)
+      options.max_ticks = atoi(argv[++i]);
+  }
+  if (options.tick_rate <= 0.0 || options.max_ticks < 1) {
+    std::cout << "ERROR::TIMESTEP::INVALID_OPTIONS: tick rate " << options.tick_rate << ", max ticks "
+              << options.max_ticks << std::endl;
+    options = TimestepOptions();
+  }
+  return options;
+}
+
+// runs the simulation at a fixed rate whatever the frame rate
+//
+//   timestep.init(parse_timestep_options(argc, argv), platform.get_time());
+//   while (...) {
+//     for (int n = timestep.advance(platform.get_time()); n > 0; n--) {
+//       previous = current;
+//       simulate(current, timestep.step);
+//     }
+//     render(interpolate(previous, current, timestep.alpha));
+//   }
+//
+// Frame time goes into an accumulator and whole ticks are taken out of it.
+// What is left over, as a fraction of a tick, is `alpha`: how far the
+// present lies between the last two simulated states. Rendering the blend
+// of those two states is smooth at any frame rate, at the price of showing
+// the simulation one tick late.
+//
+// A frame that would need more than max_ticks ticks (a hitch, or a
+// simulation slower than real time) runs max_ticks and drops the rest of
+// the backlog. Otherwise every tick makes the next frame later still, which
+// needs even more ticks: the spiral of death.
+class FixedTimestep {
+public:
+  TimestepOptions options;
+  double step = 1.0 / 60.0; // seconds per tick
+  double alpha = 0.0;       // 0..1, from the previous state to the current one
+  long ticks = 0;           // ticks run in total
+  long clamped_frames = 0;  // frames that hit max_ticks
+  double dropped = 0.0;     // seconds of simulation skipped by the clamp
+
+  void init(const TimestepOptions &timestep_options, double now) {
+    options = timestep_options;
+    step = 1.0 / options.tick_rate;
+    last_time = now;
+    accumulator = 0.0;
+  }
+
+  // ticks to run for the frame at `now`, sets alpha
+  int advance(double now) {
+    double frame_time = now - last_time;
+    last_time = now;
+    if (frame_time > 0.0)
+      accumulator += frame_time;
+
+    // a hair of tolerance, so a frame time of exactly one tick is one tick
+    // and not sometimes zero and then two
+    int count = (int)((accumulator + step * 1e-6) / step);
+    if (count > options.max_ticks) {
+      dropped += (count - options.max_ticks) * step;
+      accumulator -= (count - options.max_ticks) * step;
+      count = options.max_ticks;
+      clamped_frames++;
+    }
+    accumulator -= count * step;
+    if (accumulator < 0.0)
+      accumulator = 0.0;
+    alpha = accumulator / step;
+    ticks += count;
+    return count;
+  }
+
+  // simulated time, the time of the current state
+  double time() const { return ticks * step; }
+
+  void report(std::ostream &out) const {
+    out << "simulation: " << ticks << " ticks at " << options.tick_rate << " Hz";
+    if (clamped_frames > 0)
+      out << ", " << clamped_frames << " frames clamped to " << options.max_ticks << " ticks, " << dropped
+          << " s dropped";
+    out << std::endl;
+  }
+
+private:
+  double last_time = 0.0;
+  double accumulator = 0.0;
+};
+
+#endif // FIXED_TIMESTEP_H
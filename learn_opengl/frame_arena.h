@@ -0,0 +1,144 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// bump allocator for data that lives for one frame
+//
+// allocate() moves a pointer forward, deallocation does nothing and reset()
+// takes everything back at once. When a frame outgrows the current block a
+// new one is chained on; the next reset() replaces the chain with a single
+// block of the combined size, so once the frames stop growing the arena
+// stops asking the heap for memory.
+class FrameArena {
+public:
+  explicit FrameArena(size_t block_size = 256 * 1024) : block_size(block_size) {}
+  ~FrameArena() { release(); }
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    uintptr_t aligned = (cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (blocks.empty() || aligned + size > end) {
+      grow(size + alignment);
+      aligned = (cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    cursor = aligned + size;
+    in_use += size;
+    return (void *)aligned;
+  }
+
+  template <typename T> T *allocate_array(size_t count) { return (T *)allocate(count * sizeof(T), alignof(T)); }
+
+  // everything allocated since the last reset() is gone
+  void reset() {
+    if (blocks.size() > 1) {
+      size_t total = 0;
+      for (const Block &block : blocks)
+        total += block.size;
+      release();
+      block_size = total;
+    }
+    if (!blocks.empty()) {
+      cursor = (uintptr_t)blocks[0].memory;
+      end = cursor + blocks[0].size;
+    }
+    peak = in_use > peak ? in_use : peak;
+    in_use = 0;
+  }
+
+  size_t used() const { return in_use; }
+  size_t high_water() const { return in_use > peak ? in_use : peak; }
+  size_t capacity() const {
+    size_t total = 0;
+    for (const Block &block : blocks)
+      total += block.size;
+    return total;
+  }
+
+  uint64_t frame = 0; // the frame it was last reset for, see frame_arena()
+
+private:
+  struct Block {
+    void *memory;
+    size_t size;
+  };
+
+  std::vector<Block> blocks;
+  uintptr_t cursor = 0, end = 0;
+  size_t block_size;
+  size_t in_use = 0, peak = 0;
+
+  void grow(size_t at_least) {
+    size_t size = blocks.empty() ? block_size : blocks.back().size * 2;
+    while (size < at_least)
+      size *= 2;
+    void *memory = malloc(size);
+    if (!memory) {
+      std::cout << "ERROR::FRAME_ARENA::OUT_OF_MEMORY: " << size << " bytes" << std::endl;
+      abort();
+    }
+    blocks.push_back({memory, size});
+    cursor = (uintptr_t)memory;
+    end = cursor + size;
+  }
+
+  void release() {
+    for (const Block &block : blocks)
+      free(block.memory);
+    blocks.clear();
+    cursor = end = 0;
+  }
+};
+
+// the frame number frame_arena() resets against
+inline std::atomic<uint64_t> &arena_frame() {
+  static std::atomic<uint64_t> frame(1);
+  return frame;
+}
+
+// start a new frame for every thread's arena; call when nothing allocated in
+// the last frame is in use any more, on any thread
+inline void next_arena_frame() { arena_frame().fetch_add(1, std::memory_order_release); }
+
+// the calling thread's arena, reset the first time it is used in a frame, so
+// job workers get one without any registration
+inline FrameArena &frame_arena() {
+  static thread_local FrameArena arena;
+  uint64_t frame = arena_frame().load(std::memory_order_acquire);
+  if (arena.frame != frame) {
+    arena.reset();
+    arena.frame = frame;
+  }
+  return arena;
+}
+
+// STL allocator on a FrameArena, frame_arena() by default:
+//
+//   FrameVector<uint32_t> order(count); // no heap, gone at the next frame
+template <typename T> class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  FrameArena *arena;
+
+  ArenaAllocator() : arena(&frame_arena()) {}
+  explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count) { return arena->allocate_array<T>(count); }
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <typename T> using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // FRAME_ARENA_H
@@ -0,0 +1,213 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+enum PacingMode {
+  PACING_VSYNC,    // swap interval 1
+  PACING_ADAPTIVE, // swap interval -1: vsync, but tear instead of halving the rate on a late frame
+  PACING_UNCAPPED, // swap interval 0
+};
+
+// command line switches of the frame pacer
+//
+//   --pacing vsync|adaptive|uncapped   (default vsync, uncapped when headless)
+//   --fps N                            limit to N frames per second
+struct PacingOptions {
+  PacingMode mode = PACING_VSYNC;
+  double fps = 0.0; // 0 = no limiter
+};
+
+inline PacingOptions parse_pacing_options(int argc, char **argv, bool headless) {
+  PacingOptions options;
+  if (headless)
+    options.mode = PACING_UNCAPPED;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--pacing") == 0) {
+      const char *mode = argv[++i];
+      if (strcmp(mode, "vsync") == 0)
+        options.mode = PACING_VSYNC;
+      else if (strcmp(mode, "adaptive") == 0)
+        options.mode = PACING_ADAPTIVE;
+      else if (strcmp(mode, "uncapped") == 0)
+        options.mode = PACING_UNCAPPED;
+      else
+        std::cout << "ERROR::PACING::UNKNOWN_MODE: " << mode << std::endl;
+    } else if (strcmp(argv[i], "--fps") == 0) {
+      options.fps = atof(argv[++i]);
+    }
+  }
+  return options;
+}
+
+// paces the frame loop and measures how long input takes to reach the screen
+//
+//   pacer.wait();           // frame limiter, before input is sampled
+//   platform.poll_events();
+//   pacer.mark_input();
+//   ... update, render ...
+//   platform.swap_buffers();
+//   pacer.frame_submitted(); // fence marking the end of this frame's GPU work
+//
+// The limiter sleeps until shortly before the deadline and spins for the
+// rest, OS sleeps overshoot by up to a scheduler tick. Sleeping before input
+// is sampled rather than after keeps the wait out of the latency.
+//
+// Latency is measured from mark_input() to the GPU finishing the frame: a
+// GL_TIMESTAMP query behind the swap, converted to the CPU clock. It does not
+// depend on when the result is polled, and the display adds its scanout on
+// top. A fence behind the query tells when the result is there. At most
+// `max_frames_in_flight` fences are outstanding, once reached
+// frame_submitted() waits for the oldest, which keeps the driver from queuing
+// frames and latency from growing.
+class FramePacer {
+public:
+  PacingOptions options;
+  int max_frames_in_flight = 2;
+  double spin_margin = 2.0; // ms before the deadline where sleeping stops
+
+  ProfileWindow frame_times; // ms between wait() returning, what the user sees
+  ProfileWindow latency;     // ms from mark_input() to the GPU finishing the frame
+
+  // apply the swap interval, needs the context current
+  void init(const Platform &platform, const PacingOptions &pacing_options) {
+    options = pacing_options;
+    if (!platform.window)
+      return; // nothing to sync to offscreen
+    int interval = 1;
+    if (options.mode == PACING_UNCAPPED) {
+      interval = 0;
+    } else if (options.mode == PACING_ADAPTIVE) {
+      if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+        interval = -1;
+      else
+        std::cout << "adaptive vsync not supported, using vsync" << std::endl;
+    }
+    glfwSwapInterval(interval);
+  }
+
+  // block until the next frame is due when a limit is set
+  void wait() {
+    double now = clock_ms();
+    if (options.fps > 0.0) {
+      double period = 1000.0 / options.fps;
+      deadline = deadline == 0.0 ? now : deadline + period;
+      // more than a frame late: start over instead of rushing to catch up
+      if (now - deadline > period)
+        deadline = now;
+      if (deadline - now > spin_margin)
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(deadline - now - spin_margin));
+      while ((now = clock_ms()) < deadline)
+        std::this_thread::yield();
+    }
+    if (last_frame != 0.0)
+      frame_times.add(now - last_frame);
+    last_frame = now;
+  }
+
+  void mark_input() { input_time = clock_ms(); }
+
+  void frame_submitted() {
+    double now = clock_ms();
+    if (now - calibrated > 1000.0)
+      calibrate(now);
+    PendingFrame frame;
+    frame.query = take_query();
+    frame.input_time = input_time;
+    glQueryCounter(frame.query, GL_TIMESTAMP);
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending.push_back(frame);
+    while (!pending.empty()) {
+      bool must_wait = (int)pending.size() > max_frames_in_flight;
+      GLenum status = glClientWaitSync(pending.front().fence, must_wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                       must_wait ? 1000000000ull : 0);
+      if (status == GL_TIMEOUT_EXPIRED && !must_wait)
+        break;
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        GLuint64 done = 0;
+        glGetQueryObjectui64v(pending.front().query, GL_QUERY_RESULT, &done);
+        latency.add(done / 1e6 + gpu_to_cpu - pending.front().input_time);
+      }
+      glDeleteSync(pending.front().fence);
+      free_queries.push_back(pending.front().query);
+      pending.pop_front();
+    }
+  }
+
+  // one line with frame time and latency min/avg/p99
+  void report(std::ostream &out) const {
+    static const char *mode_names[] = {"vsync", "adaptive", "uncapped"};
+    ProfileStats frame = frame_times.stats(), lag = latency.stats();
+    out << mode_names[options.mode];
+    if (options.fps > 0.0)
+      out << " @" << options.fps;
+    out << ": frame " << frame.min << "/" << frame.avg << "/" << frame.p99 << " ms, input to GPU done " << lag.min
+        << "/" << lag.avg << "/" << lag.p99 << " ms (min/avg/p99)" << std::endl;
+  }
+
+  // release outstanding fences, call while the context is still current
+  void destroy() {
+    for (const PendingFrame &frame : pending) {
+      glDeleteSync(frame.fence);
+      free_queries.push_back(frame.query);
+    }
+    pending.clear();
+    if (!free_queries.empty())
+      glDeleteQueries((GLsizei)free_queries.size(), free_queries.data());
+    free_queries.clear();
+  }
+
+private:
+  struct PendingFrame {
+    GLsync fence;
+    GLuint query; // GL_TIMESTAMP of the end of the frame
+    double input_time;
+  };
+
+  double deadline = 0.0;
+  double last_frame = 0.0;
+  double input_time = 0.0;
+  double calibrated = 0.0; // clock_ms() of the last calibrate()
+  double gpu_to_cpu = 0.0; // ms to add to a GPU timestamp to get clock_ms()
+  std::deque<PendingFrame> pending;
+  std::vector<GLuint> free_queries;
+
+  // the GPU clock runs on its own, measure its offset now and then so drift
+  // stays out of the latency
+  void calibrate(double now) {
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    gpu_to_cpu = now - gpu_now / 1e6;
+    calibrated = now;
+  }
+
+  GLuint take_query() {
+    GLuint query;
+    if (free_queries.empty()) {
+      glGenQueries(1, &query);
+    } else {
+      query = free_queries.back();
+      free_queries.pop_back();
+    }
+    return query;
+  }
+
+  static double clock_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+};
+
+#endif // FRAME_PACING_H
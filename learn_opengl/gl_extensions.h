@@ -0,0 +1,21 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include "glad/glad.h"
+
+#include <cstring>
+
+// the glad loader in thirdparty is generated without extensions, so query the
+// context directly. Only meant for setup code, it walks the whole list.
+inline bool has_gl_extension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (extension && strcmp(extension, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+#endif // GL_EXTENSIONS_H
@@ -0,0 +1,390 @@
+#ifndef GL_RESOURCE_H
+#define GL_RESOURCE_H
+
+#include "glad/glad.h"
+
+#include "gpu_memory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+enum GlObjectType {
+  GL_OBJECT_BUFFER,
+  GL_OBJECT_VERTEX_ARRAY,
+  GL_OBJECT_TEXTURE,
+  GL_OBJECT_PROGRAM,
+  GL_OBJECT_FRAMEBUFFER
+};
+
+// refers to a wrapped GL object for as long as it lives; stale handles are
+// detected. Slot 0 is never used, so a zeroed handle is null.
+struct GlHandle {
+  uint32_t slot = 0;
+  uint32_t generation = 0;
+
+  explicit operator bool() const { return slot != 0; }
+};
+
+// the GL names of the live wrapped objects, behind generation checked handles
+//
+// A handle can be stored anywhere (a material, a render queue command) and
+// resolved once per use. name() of a handle whose object is gone returns 0
+// instead of a name GL may since have handed to something else. replace()
+// swaps the object behind a handle, e.g. a texture reallocated with fewer
+// mip levels, and everyone holding the handle follows.
+class GlObjectTable {
+public:
+  GlObjectTable() : slots(1) {}
+
+  GlHandle add(GlObjectType type, unsigned int name) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = (uint32_t)slots.size();
+      slots.push_back(Slot());
+    }
+    slots[slot].type = type;
+    slots[slot].name = name;
+    GlHandle handle;
+    handle.slot = slot;
+    handle.generation = slots[slot].generation;
+    return handle;
+  }
+
+  // the handle and every copy of it go stale
+  void remove(GlHandle handle) {
+    if (!alive(handle))
+      return;
+    slots[handle.slot].name = 0;
+    slots[handle.slot].generation++;
+    free_slots.push_back(handle.slot);
+  }
+
+  bool alive(GlHandle handle) const {
+    return handle.slot != 0 && handle.slot < slots.size() && slots[handle.slot].generation == handle.generation;
+  }
+
+  unsigned int name(GlHandle handle) const { return alive(handle) ? slots[handle.slot].name : 0; }
+
+  // `type` has to match the object's, a texture handle used as a buffer is
+  // an error
+  unsigned int name(GlHandle handle, GlObjectType type) const {
+    if (!alive(handle))
+      return 0;
+    if (slots[handle.slot].type != type) {
+      std::cout << "ERROR::GL_RESOURCE::WRONG_TYPE: handle " << handle.slot << " used as type " << type << std::endl;
+      return 0;
+    }
+    return slots[handle.slot].name;
+  }
+
+  void replace(GlHandle handle, unsigned int name) {
+    if (alive(handle))
+      slots[handle.slot].name = name;
+  }
+
+  size_t size() const { return slots.size() - 1 - free_slots.size(); }
+
+private:
+  struct Slot {
+    GlObjectType type = GL_OBJECT_BUFFER;
+    unsigned int name = 0;
+    uint32_t generation = 0; // bumped when the slot's object goes
+  };
+
+  std::vector<Slot> slots;
+  std::vector<uint32_t> free_slots;
+};
+
+inline GlObjectTable &gl_objects() {
+  static GlObjectTable table;
+  return table;
+}
+
+// deletes GL objects once the GPU is done with them
+//
+//   gl_delete_queue().retire(GL_OBJECT_BUFFER, buffer); // any time, no GL call
+//   ...
+//   platform.swap_buffers();
+//   gl_delete_queue().next_frame();
+//
+// Objects retired during a frame form a batch. next_frame() puts a fence
+// behind the batch and deletes the batches whose fence has signalled, so an
+// object goes once the last command that could use it has run and
+// glDelete* never waits for the GPU. next_frame() never blocks.
+//
+// Retired buffers are not deleted right away but recycled: take_buffer()
+// hands out one of the same size and usage whose fence has signalled, so a
+// buffer streamed per frame can be refilled without glBufferData orphaning or
+// a stall. A pooled buffer that is not taken within POOL_FRAMES frames is
+// deleted, and so are the oldest ones beyond POOL_BYTES. Pooled buffers are
+// tracked in gpu_memory() as "recycled buffers".
+class GlDeleteQueue {
+public:
+  static const size_t POOL_BYTES = 16 * 1024 * 1024;
+  static const long POOL_FRAMES = 8;
+
+  long deleted = 0;  // objects deleted
+  long recycled = 0; // buffers handed out again by take_buffer()
+
+  // no GL call, so it is fine from a destructor that runs after the context
+  // is gone; the object simply never gets deleted then
+  void retire(GlObjectType type, unsigned int name) {
+    if (!name)
+      return;
+    Retired object = {type, name, 0, GL_NONE, 0};
+    if (type == GL_OBJECT_BUFFER) {
+      if (const GpuAllocation *allocation = gpu_memory().find(GPU_BUFFER, name)) {
+        object.bytes = allocation->bytes;
+        object.usage = allocation->usage;
+        gpu_memory().track_buffer(name, object.bytes, object.usage, "retired buffers");
+      }
+    } else if (type == GL_OBJECT_TEXTURE) {
+      gpu_memory().release(GPU_TEXTURE, name);
+    }
+    current.push_back(object);
+  }
+
+  // a recycled buffer of exactly `bytes` and `usage`, tracked under `owner`
+  // again, or 0 when the pool has none; its contents are undefined
+  unsigned int take_buffer(size_t bytes, GLenum usage, const char *owner) {
+    for (size_t i = 0; i < pool.size(); i++) {
+      if (pool[i].bytes != bytes || pool[i].usage != usage)
+        continue;
+      unsigned int buffer = pool[i].name;
+      pool.erase(pool.begin() + i);
+      gpu_memory().track_buffer(buffer, bytes, usage, owner);
+      recycled++;
+      return buffer;
+    }
+    return 0;
+  }
+
+  void next_frame() {
+    frame++;
+    if (!current.empty()) {
+      Batch batch;
+      batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      batch.objects.swap(current);
+      batches.push_back(std::move(batch));
+    }
+    // fences signal in order, so stop at the first one still pending
+    size_t done = 0;
+    while (done < batches.size()) {
+      GLenum status = glClientWaitSync(batches[done].fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        break;
+      glDeleteSync(batches[done].fence);
+      for (const Retired &object : batches[done].objects)
+        release(object);
+      done++;
+    }
+    batches.erase(batches.begin(), batches.begin() + done);
+    // oldest first: evict the unused ones, then whatever exceeds the bytes
+    size_t bytes = pooled_bytes(), evict = 0;
+    while (evict < pool.size() && (frame - pool[evict].frame > POOL_FRAMES || bytes > POOL_BYTES)) {
+      bytes -= pool[evict].bytes;
+      destroy(pool[evict++]);
+    }
+    pool.erase(pool.begin(), pool.begin() + evict);
+  }
+
+  // objects retired but not deleted or pooled yet
+  size_t pending() const {
+    size_t count = current.size();
+    for (const Batch &batch : batches)
+      count += batch.objects.size();
+    return count;
+  }
+
+  size_t pooled() const { return pool.size(); }
+
+  size_t pooled_bytes() const {
+    size_t bytes = 0;
+    for (const Retired &object : pool)
+      bytes += object.bytes;
+    return bytes;
+  }
+
+  // bytes of the buffers retired or pooled: still allocated, but released
+  // within a few frames without anyone's help, so not worth freeing memory
+  // for, see MemoryBudget
+  size_t reclaimable_bytes() const {
+    size_t bytes = pooled_bytes();
+    for (const Retired &object : current)
+      bytes += object.bytes;
+    for (const Batch &batch : batches)
+      for (const Retired &object : batch.objects)
+        bytes += object.bytes;
+    return bytes;
+  }
+
+  // waits for the GPU and deletes everything, pool included; call before the
+  // context goes
+  void flush() {
+    glFinish();
+    for (Batch &batch : batches) {
+      glDeleteSync(batch.fence);
+      current.insert(current.end(), batch.objects.begin(), batch.objects.end());
+    }
+    batches.clear();
+    current.insert(current.end(), pool.begin(), pool.end());
+    pool.clear();
+    for (const Retired &object : current)
+      destroy(object);
+    current.clear();
+  }
+
+private:
+  struct Retired {
+    GlObjectType type;
+    unsigned int name;
+    size_t bytes; // buffers: the size and usage they were specified with
+    GLenum usage;
+    long frame; // pooled buffers: the frame they were pooled in
+  };
+
+  struct Batch {
+    GLsync fence;
+    std::vector<Retired> objects;
+  };
+
+  std::vector<Retired> current; // retired this frame
+  std::vector<Batch> batches;   // oldest first
+  std::vector<Retired> pool;    // buffers the GPU is done with, oldest first
+  long frame = 0;               // next_frame() calls
+
+  void release(const Retired &object) {
+    if (object.type == GL_OBJECT_BUFFER && object.bytes > 0 && object.bytes <= POOL_BYTES) {
+      gpu_memory().track_buffer(object.name, object.bytes, object.usage, "recycled buffers");
+      pool.push_back(object);
+      pool.back().frame = frame;
+    } else {
+      destroy(object);
+    }
+  }
+
+  void destroy(const Retired &object) {
+    switch (object.type) {
+    case GL_OBJECT_BUFFER:
+      gpu_memory().release(GPU_BUFFER, object.name);
+      glDeleteBuffers(1, &object.name);
+      break;
+    case GL_OBJECT_VERTEX_ARRAY:
+      glDeleteVertexArrays(1, &object.name);
+      break;
+    case GL_OBJECT_TEXTURE:
+      glDeleteTextures(1, &object.name);
+      break;
+    case GL_OBJECT_PROGRAM:
+      glDeleteProgram(object.name);
+      break;
+    case GL_OBJECT_FRAMEBUFFER:
+      glDeleteFramebuffers(1, &object.name);
+      break;
+    }
+    deleted++;
+  }
+};
+
+inline GlDeleteQueue &gl_delete_queue() {
+  static GlDeleteQueue queue;
+  return queue;
+}
+
+// move-only owner of one GL object
+//
+//   GlBuffer VBO = GlBuffer::create();
+//   glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+//   GlTexture texture = GlTexture::adopt(load_texture(...));
+//
+// The object is registered in gl_objects(), handle() can be handed out and
+// name() always resolves through it. When the owner goes, the object is
+// retired into gl_delete_queue() and deleted once the GPU is done with it,
+// so dropping a buffer the last frame still reads is safe. Distinct types
+// for buffers, vertex arrays and so on turn a swapped argument into a
+// compile error.
+template <GlObjectType TYPE> class GlObject {
+public:
+  GlObject() {}
+  ~GlObject() { reset(); }
+
+  GlObject(const GlObject &) = delete;
+  GlObject &operator=(const GlObject &) = delete;
+
+  GlObject(GlObject &&other) noexcept : object(other.object) { other.object = GlHandle(); }
+  GlObject &operator=(GlObject &&other) noexcept {
+    if (this != &other) {
+      reset();
+      object = other.object;
+      other.object = GlHandle();
+    }
+    return *this;
+  }
+
+  static GlObject create() {
+    unsigned int name = 0;
+    switch (TYPE) {
+    case GL_OBJECT_BUFFER:
+      glGenBuffers(1, &name);
+      break;
+    case GL_OBJECT_VERTEX_ARRAY:
+      glGenVertexArrays(1, &name);
+      break;
+    case GL_OBJECT_TEXTURE:
+      glGenTextures(1, &name);
+      break;
+    case GL_OBJECT_PROGRAM:
+      name = glCreateProgram();
+      break;
+    case GL_OBJECT_FRAMEBUFFER:
+      glGenFramebuffers(1, &name);
+      break;
+    }
+    return adopt(name);
+  }
+
+  // take ownership of a name made elsewhere, e.g. by load_texture
+  static GlObject adopt(unsigned int name) {
+    GlObject result;
+    if (name)
+      result.object = gl_objects().add(TYPE, name);
+    return result;
+  }
+
+  unsigned int name() const { return gl_objects().name(object, TYPE); }
+  GlHandle handle() const { return object; }
+  explicit operator bool() const { return name() != 0; }
+
+  // stop owning the object without retiring it, the caller deletes it
+  unsigned int release() {
+    unsigned int name = gl_objects().name(object);
+    gl_objects().remove(object);
+    object = GlHandle();
+    return name;
+  }
+
+  // retire the object now instead of with the owner
+  void reset() {
+    if (!object)
+      return;
+    gl_delete_queue().retire(TYPE, gl_objects().name(object));
+    gl_objects().remove(object);
+    object = GlHandle();
+  }
+
+private:
+  GlHandle object;
+};
+
+typedef GlObject<GL_OBJECT_BUFFER> GlBuffer;
+typedef GlObject<GL_OBJECT_VERTEX_ARRAY> GlVertexArray;
+typedef GlObject<GL_OBJECT_TEXTURE> GlTexture;
+typedef GlObject<GL_OBJECT_PROGRAM> GlProgram;
+typedef GlObject<GL_OBJECT_FRAMEBUFFER> GlFramebuffer;
+
+#endif // GL_RESOURCE_H
@@ -0,0 +1,245 @@
+// golden image and frame time regression check for one demo
+//
+//   golden_check [options] <name> <demo executable> [demo arguments]
+//
+// runs the demo headless for a fixed number of frames, compares its last
+// frame with learn_opengl/golden/<name>.png and its median frame time with
+// the baseline recorded by an earlier run; exits non-zero on a regression.
+// Run it from the repository root, like the demos.
+//
+//   --update             store this run as the new golden image and baseline
+//   --frames N           frames to render (default 60)
+//   --golden-dir DIR     golden images (default learn_opengl/golden)
+//   --out-dir DIR        output and diff images (default golden_out)
+//   --baseline-dir DIR   timing baselines (default the output directory)
+//   --require-baseline   fail instead of recording when there is no baseline
+//   --threshold F        perceptual difference of a pixel that counts, 0..1 (default 0.1)
+//   --tolerance F        fraction of pixels allowed to differ (default 0.002)
+//   --max-regression F   allowed increase of the median frame time (default 0.15)
+//   --noise-floor MS     increases below this always pass, for demos whose
+//                        frames take next to nothing (default 0.5)
+//
+// Images are compared at half resolution, which smooths out rasterization
+// differences between drivers, with the YIQ color distance of pixelmatch:
+// brightness counts about twice as much as hue. Golden images are portable,
+// timing baselines are only meaningful on the machine that recorded them and
+// are therefore not kept in the repository. Without a baseline the first run
+// records one and reports "no baseline". A CI machine keeps its baselines in
+// a --baseline-dir that outlives the build and passes --require-baseline, so
+// a lost baseline fails instead of passing unchecked.
+
+#include <glad/glad.h>
+
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0755)
+#endif
+
+struct CheckOptions {
+  bool update = false;
+  int frames = 60;
+  std::string golden_dir = "learn_opengl/golden";
+  std::string out_dir = "golden_out";
+  std::string baseline_dir; // empty: out_dir
+  bool require_baseline = false;
+  double threshold = 0.1;
+  double tolerance = 0.002;
+  double max_regression = 0.15;
+  double noise_floor = 0.5; // ms
+};
+
+// squared YIQ distance, 0 to 35215
+double color_delta(const unsigned char *a, const unsigned char *b) {
+  double r = a[0] - b[0], g = a[1] - b[1], bl = a[2] - b[2];
+  double y = r * 0.29889531 + g * 0.58662247 + bl * 0.11448223;
+  double i = r * 0.59597799 - g * 0.27417610 - bl * 0.32180189;
+  double q = r * 0.21147017 - g * 0.52261711 + bl * 0.31114694;
+  return 0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q;
+}
+
+// fraction of differing pixels; `diff` gets them in red over a faded copy
+double compare_images(const Image &golden, const Image &candidate, double threshold, Image &diff) {
+  diff = candidate;
+  double max_delta = 35215.0 * threshold * threshold;
+  long differing = 0;
+  for (size_t i = 0, n = (size_t)golden.width * golden.height; i < n; i++) {
+    const unsigned char *a = &golden.pixels[i * 3], *b = &candidate.pixels[i * 3];
+    unsigned char *out = &diff.pixels[i * 3];
+    if (color_delta(a, b) > max_delta) {
+      differing++;
+      out[0] = 255;
+      out[1] = out[2] = 0;
+    } else {
+      unsigned char gray = (unsigned char)(255 - (255 - (a[0] + a[1] + a[2]) / 3) / 4);
+      out[0] = out[1] = out[2] = gray;
+    }
+  }
+  return (double)differing / ((size_t)golden.width * golden.height);
+}
+
+bool read_median(const std::string &path, double &median) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (!file)
+    return false;
+  char key[64];
+  double value;
+  bool found = false;
+  while (fscanf(file, "%63s %lf", key, &value) == 2)
+    if (strcmp(key, "median_ms") == 0) {
+      median = value;
+      found = true;
+    }
+  fclose(file);
+  return found;
+}
+
+bool copy_file(const std::string &from, const std::string &to) {
+  FILE *in = fopen(from.c_str(), "rb");
+  FILE *out = in ? fopen(to.c_str(), "wb") : NULL;
+  if (!out) {
+    if (in)
+      fclose(in);
+    std::cout << "ERROR::GOLDEN::COPY_FAILED: " << from << " -> " << to << std::endl;
+    return false;
+  }
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    fwrite(buffer, 1, size, out);
+  fclose(in);
+  return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+  CheckOptions options;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    std::string flag = argv[arg];
+    bool has_value = arg + 1 < argc;
+    if (flag == "--update")
+      options.update = true;
+    else if (flag == "--frames" && has_value)
+      options.frames = atoi(argv[++arg]);
+    else if (flag == "--golden-dir" && has_value)
+      options.golden_dir = argv[++arg];
+    else if (flag == "--out-dir" && has_value)
+      options.out_dir = argv[++arg];
+    else if (flag == "--baseline-dir" && has_value)
+      options.baseline_dir = argv[++arg];
+    else if (flag == "--require-baseline")
+      options.require_baseline = true;
+    else if (flag == "--threshold" && has_value)
+      options.threshold = atof(argv[++arg]);
+    else if (flag == "--tolerance" && has_value)
+      options.tolerance = atof(argv[++arg]);
+    else if (flag == "--max-regression" && has_value)
+      options.max_regression = atof(argv[++arg]);
+    else if (flag == "--noise-floor" && has_value)
+      options.noise_floor = atof(argv[++arg]);
+    else
+      std::cout << "unknown option " << flag << std::endl;
+  }
+  if (argc - arg < 2) {
+    std::cout << "usage: " << argv[0] << " [options] <name> <demo executable> [demo arguments]" << std::endl;
+    return 2;
+  }
+  std::string name = argv[arg], demo = argv[arg + 1];
+
+  // 1. render
+  make_directory(options.out_dir.c_str());
+  if (options.baseline_dir.empty())
+    options.baseline_dir = options.out_dir;
+  else
+    make_directory(options.baseline_dir.c_str());
+  std::string output = options.out_dir + "/" + name + ".png";
+  std::string stats = options.out_dir + "/" + name + ".stats";
+  std::string baseline = options.baseline_dir + "/" + name + ".baseline";
+  std::string golden_path = options.golden_dir + "/" + name + ".png";
+  std::string command = "\"" + demo + "\" --headless --frames " + std::to_string(options.frames) + " --dump \"" +
+                        output + "\" --stats \"" + stats + "\"";
+  for (int i = arg + 2; i < argc; i++)
+    command += std::string(" \"") + argv[i] + "\"";
+  command += " > \"" + options.out_dir + "/" + name + ".log\" 2>&1";
+  if (std::system(command.c_str()) != 0) {
+    std::cout << "FAIL " << name << ": the demo failed, see " << options.out_dir << "/" << name << ".log" << std::endl;
+    return 1;
+  }
+
+  Image frame;
+  double median;
+  if (!load_image(output.c_str(), false, 3, frame) || !read_median(stats, median)) {
+    std::cout << "FAIL " << name << ": no frame or frame times from the demo" << std::endl;
+    return 1;
+  }
+  Image candidate = downsample_image(frame);
+
+  if (options.update) {
+    bool ok = stbi_write_png(golden_path.c_str(), candidate.width, candidate.height, 3, candidate.pixels.data(), 0) &&
+              copy_file(stats, baseline);
+    std::cout << (ok ? "UPDATED " : "FAIL ") << name << ": " << golden_path << ", median " << median << " ms"
+              << std::endl;
+    return ok ? 0 : 1;
+  }
+
+  // 2. image
+  bool passed = true;
+  Image golden;
+  if (!load_image(golden_path.c_str(), false, 3, golden)) {
+    std::cout << "FAIL " << name << ": no golden image " << golden_path << ", create it with --update" << std::endl;
+    return 1;
+  }
+  if (golden.width != candidate.width || golden.height != candidate.height) {
+    std::cout << "FAIL " << name << ": " << candidate.width << "x" << candidate.height << " against a golden image of "
+              << golden.width << "x" << golden.height << std::endl;
+    return 1;
+  }
+  Image diff;
+  double differing = compare_images(golden, candidate, options.threshold, diff);
+  if (differing > options.tolerance) {
+    std::string diff_path = options.out_dir + "/" + name + ".diff.png";
+    stbi_write_png(diff_path.c_str(), diff.width, diff.height, 3, diff.pixels.data(), 0);
+    std::cout << "FAIL " << name << ": " << differing * 100.0 << "% of the pixels differ (tolerance "
+              << options.tolerance * 100.0 << "%), see " << diff_path << std::endl;
+    passed = false;
+  }
+
+  // 3. frame time, the first run on a machine records the baseline
+  double baseline_median;
+  bool has_baseline = read_median(baseline, baseline_median);
+  if (!has_baseline && options.require_baseline) {
+    std::cout << "FAIL " << name << ": no frame time baseline " << baseline << ", record it with --update"
+              << std::endl;
+    passed = false;
+  } else if (!has_baseline) {
+    copy_file(stats, baseline);
+    std::cout << "no frame time baseline for " << name << ", recorded " << baseline << ": " << median << " ms"
+              << std::endl;
+  } else if (median > baseline_median * (1.0 + options.max_regression) &&
+             median > baseline_median + options.noise_floor) {
+    std::cout << "FAIL " << name << ": median frame time " << median << " ms against a baseline of "
+              << baseline_median << " ms (+" << (median / baseline_median - 1.0) * 100.0 << "%, allowed +"
+              << options.max_regression * 100.0 << "%)" << std::endl;
+    passed = false;
+  }
+
+  if (passed)
+    std::cout << "PASS " << name << ": " << differing * 100.0 << "% of the pixels differ, median " << median
+              << " ms" << (has_baseline ? "" : ", no baseline") << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include "glad/glad.h"
+
+#include "gl_extensions.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// GL_NVX_gpu_memory_info and GL_ATI_meminfo, the glad loader has neither
+#define GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX 0x9047
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#define GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX 0x904B
+#define GL_VBO_FREE_MEMORY_ATI 0x87FB
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+
+enum GpuResourceKind { GPU_BUFFER, GPU_TEXTURE, GPU_RENDERBUFFER };
+
+inline const char *gpu_resource_kind_name(GpuResourceKind kind) {
+  return kind == GPU_BUFFER ? "buffer" : kind == GPU_TEXTURE ? "texture" : "renderbuffer";
+}
+
+// bytes per texel of the sized formats the demos use. Drivers pad RGB8 to
+// four bytes, so it is counted as four; anything unknown counts as four too.
+inline size_t bytes_per_texel(GLenum internal_format) {
+  switch (internal_format) {
+  case GL_R8:
+    return 1;
+  case GL_RG8:
+  case GL_R16F:
+    return 2;
+  case GL_RGBA16F:
+  case GL_RGBA16UI:
+  case GL_RG32F:
+    return 8;
+  case GL_RGBA32F:
+    return 16;
+  default:
+    return 4;
+  }
+}
+
+// a full or partial mip chain from `width` x `height` down, `depth` layers
+inline size_t texture_bytes(GLenum internal_format, int width, int height, int depth, int levels) {
+  size_t bytes = 0;
+  for (int level = 0; level < levels; level++) {
+    bytes += (size_t)width * height * depth * bytes_per_texel(internal_format);
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+  return bytes;
+}
+
+// one tracked buffer, texture or renderbuffer
+struct GpuAllocation {
+  GpuResourceKind kind;
+  unsigned int name;
+  size_t bytes;
+  const char *owner; // a string literal, e.g. "instances"
+  GLenum usage;      // buffers: GL_STATIC_DRAW, ...
+  GLenum internal_format;
+  int width, height, depth, levels; // textures and renderbuffers
+};
+
+// tracked memory of one owner tag
+struct GpuMemoryOwner {
+  const char *owner;
+  size_t bytes;
+  int count;
+};
+
+// what the driver says about video memory, in bytes; `known` is false when
+// it has neither GL_NVX_gpu_memory_info nor GL_ATI_meminfo (Mesa, Intel)
+struct GpuDriverMemory {
+  bool known = false;
+  const char *source = "none";
+  size_t total = 0;     // dedicated video memory, NVX only
+  size_t available = 0; // currently free
+  size_t evicted = 0;   // evicted to system memory so far, NVX only
+};
+
+// central accounting of the GL memory the program allocates
+//
+//   tracked_buffer_data(GL_ARRAY_BUFFER, VBO, size, data, GL_STATIC_DRAW, "meshes");
+//   gpu_memory().track_texture(texture, GL_RGBA8, width, height, 1, levels, "textures");
+//   ...
+//   gpu_memory().release(GPU_TEXTURE, texture);
+//   gpu_memory().report(std::cout);
+//
+// The sizes are computed from the allocation calls, not asked from the
+// driver, so they are what the program requested: padding, compression and
+// the driver's own allocations are not in them. driver() adds the driver's
+// view where an extension offers one. Tracking the same name again replaces
+// its record, so a buffer that is re-specified to grow needs no release.
+class GpuMemory {
+public:
+  std::unordered_map<uint64_t, GpuAllocation> allocations;
+
+  void track_buffer(unsigned int buffer, size_t bytes, GLenum usage, const char *owner) {
+    GpuAllocation allocation = {GPU_BUFFER, buffer, bytes, owner, usage, GL_NONE, 0, 0, 0, 0};
+    allocations[key(GPU_BUFFER, buffer)] = allocation;
+  }
+
+  void track_texture(unsigned int texture, GLenum internal_format, int width, int height, int depth, int levels,
+                     const char *owner) {
+    GpuAllocation allocation = {GPU_TEXTURE,
+                                texture,
+                                texture_bytes(internal_format, width, height, depth, levels),
+                                owner,
+                                GL_NONE,
+                                internal_format,
+                                width,
+                                height,
+                                depth,
+                                levels};
+    allocations[key(GPU_TEXTURE, texture)] = allocation;
+  }
+
+  void track_renderbuffer(unsigned int renderbuffer, GLenum internal_format, int width, int height,
+                          const char *owner) {
+    GpuAllocation allocation = {GPU_RENDERBUFFER, renderbuffer, texture_bytes(internal_format, width, height, 1, 1),
+                                owner, GL_NONE, internal_format, width, height, 1, 1};
+    allocations[key(GPU_RENDERBUFFER, renderbuffer)] = allocation;
+  }
+
+  // call next to glDelete*, untracked names are ignored
+  void release(GpuResourceKind kind, unsigned int name) { allocations.erase(key(kind, name)); }
+
+  const GpuAllocation *find(GpuResourceKind kind, unsigned int name) const {
+    auto it = allocations.find(key(kind, name));
+    return it == allocations.end() ? NULL : &it->second;
+  }
+
+  size_t total() const {
+    size_t bytes = 0;
+    for (const auto &entry : allocations)
+      bytes += entry.second.bytes;
+    return bytes;
+  }
+
+  size_t total(GpuResourceKind kind) const {
+    size_t bytes = 0;
+    for (const auto &entry : allocations)
+      bytes += entry.second.kind == kind ? entry.second.bytes : 0;
+    return bytes;
+  }
+
+  // tracked bytes per owner tag, largest first
+  std::vector<GpuMemoryOwner> breakdown() const {
+    std::vector<GpuMemoryOwner> owners;
+    for (const auto &entry : allocations) {
+      const GpuAllocation &allocation = entry.second;
+      auto it = std::find_if(owners.begin(), owners.end(),
+                             [&](const GpuMemoryOwner &owner) { return owner.owner == allocation.owner; });
+      if (it == owners.end())
+        owners.push_back({allocation.owner, allocation.bytes, 1});
+      else {
+        it->bytes += allocation.bytes;
+        it->count++;
+      }
+    }
+    std::sort(owners.begin(), owners.end(),
+              [](const GpuMemoryOwner &a, const GpuMemoryOwner &b) { return a.bytes > b.bytes; });
+    return owners;
+  }
+
+  // a few glGetIntegerv, cheap enough for once a frame; the extension check
+  // walks the extension list, so it is done on the first call only
+  GpuDriverMemory driver() {
+    if (!probed) {
+      has_nvx = has_gl_extension("GL_NVX_gpu_memory_info");
+      has_ati = has_gl_extension("GL_ATI_meminfo");
+      probed = true;
+    }
+    GpuDriverMemory memory;
+    if (has_nvx) {
+      GLint total = 0, available = 0, evicted = 0; // KiB
+      glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &total);
+      glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+      glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX, &evicted);
+      memory.known = true;
+      memory.source = "GL_NVX_gpu_memory_info";
+      memory.total = (size_t)total * 1024;
+      memory.available = (size_t)available * 1024;
+      memory.evicted = (size_t)evicted * 1024;
+    } else if (has_ati) {
+      // free total, largest block, free auxiliary, largest auxiliary (KiB);
+      // textures and buffers share one pool on current hardware
+      GLint texture_free[4] = {};
+      glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, texture_free);
+      memory.known = true;
+      memory.source = "GL_ATI_meminfo";
+      memory.available = (size_t)texture_free[0] * 1024;
+    }
+    return memory;
+  }
+
+  void report(std::ostream &out) {
+    std::vector<GpuMemoryOwner> owners = breakdown();
+    out << std::fixed << std::setprecision(2);
+    out << "gpu memory (MiB): " << mib(total()) << " tracked, buffers " << mib(total(GPU_BUFFER)) << ", textures "
+        << mib(total(GPU_TEXTURE)) << ", renderbuffers " << mib(total(GPU_RENDERBUFFER)) << std::endl;
+    for (const GpuMemoryOwner &owner : owners)
+      out << "  " << std::left << std::setw(24) << owner.owner << std::right << std::setw(10) << mib(owner.bytes)
+          << "  (" << owner.count << ")" << std::endl;
+    GpuDriverMemory memory = driver();
+    if (memory.known) {
+      out << "  driver (" << memory.source << "): " << mib(memory.available) << " available";
+      if (memory.total)
+        out << " of " << mib(memory.total) << ", " << mib(memory.evicted) << " evicted";
+      out << std::endl;
+    } else {
+      out << "  driver: no memory info extension" << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+  }
+
+  static double mib(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+private:
+  bool probed = false;
+  bool has_nvx = false;
+  bool has_ati = false;
+
+  static uint64_t key(GpuResourceKind kind, unsigned int name) { return ((uint64_t)kind << 32) | name; }
+};
+
+// the accounting every helper header records into
+inline GpuMemory &gpu_memory() {
+  static GpuMemory memory;
+  return memory;
+}
+
+// glBufferData for `buffer`, which is bound to `target`, recorded under `owner`
+inline void tracked_buffer_data(GLenum target, unsigned int buffer, GLsizeiptr size, const void *data, GLenum usage,
+                                const char *owner) {
+  glBufferData(target, size, data, usage);
+  gpu_memory().track_buffer(buffer, (size_t)size, usage, owner);
+}
+
+#endif // GPU_MEMORY_H
@@ -6,13 +6,30 @@
 
 #include <GLFW/glfw3.h>
 
+#include "platform.h"
+
+#include "buffer_pool.h"
 #include "camera.h"
+#include "dynamic_resolution.h"
+#include "entity_store.h"
+#include "instance_transforms.h"
+#include "frame_pacing.h"
+#include "gl_resource.h"
+#include "gpu_memory.h"
+#include "input.h"
+#include "memory_budget.h"
+#include "profiler.h"
+#include "sampler.h"
 #include "shader.h"
 
 #include "data0.h"
 
+#include "texture.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 #include <iostream>
 
@@ -21,61 +38,35 @@ void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void apply_input();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-unsigned int load_texture(const char *texture_file, GLenum format, bool flip) {
-  int width, height, nrChannels;
-
-  if (flip) {
-    stbi_set_flip_vertically_on_load(flip);
-  }
-
-  unsigned char *data = stbi_load(texture_file, &width, &height, &nrChannels, 0);
-
-  unsigned int texture;
-  glGenTextures(1, &texture);
-
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Failed to load texture" << std::endl;
-  }
-  stbi_image_free(data);
-  return texture;
-}
-
-bool keys[1024];
-
-GLboolean first_mouse = true;
-GLfloat delta_time = 0.0f;
-GLfloat last_frame = 0.0f;
-GLfloat last_x = SCR_WIDTH / 2.0f, last_y = SCR_HEIGHT / 2.0f;
-
+// the callbacks only queue events, apply_input() moves the camera once a frame
+Input input;
 Camera camera;
+DynamicResolution resolution;
 
-void setup_vbo(unsigned int &VAO, unsigned int &VBO, unsigned int &EBO) {
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+const size_t VERTEX_STRIDE = 5 * sizeof(float);
 
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+// the mesh is a pair of ranges of a shared BufferPool; the VAO reads the
+// pool's buffer from offset 0 and draws start at the mesh's base vertex, so
+// defragmenting the pool doesn't invalidate it
+void setup_vbo(const GlVertexArray &VAO, BufferPool &meshes, BufferRange &vertices, BufferRange &elements) {
+  vertices = meshes.allocate(sizeof(cube_vertices), VERTEX_STRIDE, cube_vertices);
 
   unsigned int indices[] = {
       // note that we start from 0!
       0, 1, 3, // first Triangle
       1, 2, 3  // second Triangle
   };
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  elements = meshes.allocate(sizeof(indices), sizeof(unsigned int), indices);
+
+  glBindVertexArray(VAO.name());
+  glBindBuffer(GL_ARRAY_BUFFER, meshes.buffer(vertices));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshes.buffer(elements));
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
   glEnableVertexAttribArray(0);
@@ -86,133 +77,185 @@ void setup_vbo(unsigned int &VAO, unsigned int &VBO, unsigned int &EBO) {
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-int main() {
-
-  // glfw: initialize and configure
-  // ------------------------------
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-  // glfw window creation
-  // --------------------
-  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetKeyCallback(window, key_callback);
-
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-  glfwSetCursorPosCallback(window, mouse_callback);
+int main(int argc, char **argv) {
 
-  glfwSetScrollCallback(window, scroll_callback);
-
-  // glad: load all OpenGL function pointers
-  // ---------------------------------------
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    std::cout << "Failed to initialize GLAD" << std::endl;
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
     return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
   }
 
-  Shader shader("learn_opengl/shaders/3.6.shader.vs", "learn_opengl/shaders/3.6.shader.fs");
+  Shader shader("learn_opengl/shaders/3.6.instanced.vs", "learn_opengl/shaders/3.6.shader.fs");
 
-  unsigned int VBO, VAO, EBO;
-  setup_vbo(VBO, VAO, EBO);
+  BufferPool meshes;
+  meshes.init(64 * 1024, GL_STATIC_DRAW, "meshes");
+  GlVertexArray VAO = GlVertexArray::create();
+  BufferRange vertices, elements;
+  setup_vbo(VAO, meshes, vertices, elements);
 
   shader.use();
 
   glActiveTexture(GL_TEXTURE0); // default behavior
-  unsigned int texture1 = load_texture("learn_opengl/textures/container.jpg", GL_RGB, false);
-  glBindTexture(GL_TEXTURE_2D, texture1);
+  GlTexture texture1 = GlTexture::adopt(load_texture("learn_opengl/textures/container.jpg", GL_RGB, false));
+  glBindTexture(GL_TEXTURE_2D, texture1.name());
 
   glActiveTexture(GL_TEXTURE1);
-  unsigned int texture2 = load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true);
-  glBindTexture(GL_TEXTURE_2D, texture2);
+  GlTexture texture2 = GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true));
+  glBindTexture(GL_TEXTURE_2D, texture2.name());
 
   shader.set_int("texture1", 0);
   shader.set_int("texture2", 1);
 
-  glEnable(GL_DEPTH_TEST);
+  // filtering lives in shared sampler objects, not in the textures
+  SamplerCache samplers;
+  SamplerDesc trilinear;
+  samplers.bind(0, trilinear);
+  samplers.bind(1, trilinear);
 
-  last_frame = glfwGetTime();
-  while (!glfwWindowShouldClose(window)) {
-    GLfloat current_frame = glfwGetTime();
-    delta_time = current_frame - last_frame;
-    last_frame = current_frame;
+  glEnable(GL_DEPTH_TEST);
 
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // the scene renders at a scale of the window and is blitted up,
+  // --res-scale MIN:MAX, --gpu-budget MS, --upscale bilinear|sharpen
+  int fb_width, fb_height;
+  platform.get_framebuffer_size(&fb_width, &fb_height);
+  resolution.init(parse_resolution_options(argc, argv), fb_width, fb_height);
+
+  // --pacing vsync|adaptive|uncapped, --fps N
+  FramePacer pacer;
+  pacer.init(platform, parse_pacing_options(argc, argv, platform.headless()));
+
+  // the ten cubes, each turned 20 degrees further than the one before; none
+  // of them moves, so their matrices are uploaded once
+  InstanceTransforms transforms;
+  transforms.init();
+  transforms.attach(VAO.name());
+  for (unsigned int i = 0; i < 10; i++) {
+    EntityDesc cube;
+    cube.position = cube_positions[i];
+    cube.rotation = axis_angle(glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(20.0f * i));
+    transforms.add(cube, false);
+  }
 
-    glBindVertexArray(VAO);
+  // --memory-budget MB shrinks the two textures a mip level at a time until
+  // the tracked GPU memory fits
+  MemoryBudget budget;
+  budget.init(parse_memory_budget_options(argc, argv));
+  budget.allow_mip_drop(texture1.handle());
+  budget.allow_mip_drop(texture2.handle());
+
+  // --camera-path replaces mouse and keys with a scripted fly-through
+  bool camera_path = has_flag(argc, argv, "--camera-path");
+
+  PROFILE_START_TRACE();
+  while (!platform.should_close()) {
+    pacer.wait();
+    platform.poll_events();
+    pacer.mark_input();
+
+    GLfloat current_frame = platform.get_time();
+    input.update(platform.get_time());
+    if (camera_path)
+      camera.follow_path(current_frame);
+    else
+      apply_input();
+
+    if (budget.enforce(gpu_memory())) {
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, texture1.name());
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, texture2.name());
+    }
+#ifdef CG_PROFILE
+    for (const GpuMemoryOwner &owner : gpu_memory().breakdown())
+      PROFILE_COUNTER("gpu memory (MiB)", owner.owner, GpuMemory::mib(owner.bytes));
+#endif
 
-    shader.set_mat4("projection", glm::perspective(glm::radians(camera.fov), 800.0f / 600.0f, 0.1f, 1000.0f));
-    shader.set_mat4("view", camera.get_view());
+    PROFILE_BEGIN_FRAME();
+    resolution.begin_frame();
+    {
+      PROFILE_SCOPE("clear");
+      glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
 
-    for (unsigned int i = 0; i < 10; i++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      model = glm::translate(model, cube_positions[i]);
-      float angle = 20.0f * i;
-      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0, 0.3f, 0.5f));
-      shader.set_mat4("model", model);
+    {
+      PROFILE_SCOPE("cubes");
+      shader.set_mat4("projection", glm::perspective(glm::radians(camera.fov), resolution.aspect(), 0.1f, 1000.0f));
+      shader.set_mat4("view", camera.get_view());
 
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+      transforms.update();
+      transforms.draw(VAO.name(), 36, (int)(meshes.offset(vertices) / VERTEX_STRIDE));
     }
-
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    {
+      PROFILE_SCOPE("upscale");
+      resolution.end_frame(platform.framebuffer);
+    }
+    PROFILE_END_FRAME();
+
+    platform.swap_buffers();
+    pacer.frame_submitted();
+    // compacts the pool after meshes were freed, a no-op once it is compact
+    meshes.defragment(256 * 1024);
+    // textures replaced by the budget are deleted once no frame samples them
+    gl_delete_queue().next_frame();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
+  pacer.report(std::cout);
+  pacer.destroy();
+  if (resolution.options.gpu_budget > 0.0)
+    std::cout << "render scale " << resolution.scale << " (" << resolution.render_width() << "x"
+              << resolution.render_height() << "), scene GPU time " << resolution.gpu_time << " ms" << std::endl;
+  gpu_memory().report(std::cout);
+  budget.report(std::cout);
+  budget.destroy();
+  resolution.destroy();
+  PROFILE_REPORT(std::cout);
+  PROFILE_WRITE_TRACE("hello_camera.trace.json");
+  PROFILE_SHUTDOWN();
+
+  meshes.report(std::cout);
+  meshes.destroy();
+  VAO.reset();
+  texture1.reset();
+  texture2.reset();
+  transforms.destroy();
+  gl_delete_queue().flush();
+  samplers.destroy();
+
+  platform.terminate();
   return 0;
 }
 
-void framebuffer_size_callback(GLFWwindow *window, int width, int height) { glViewport(0, 0, width, height); }
+// the scaled target follows the window, end_frame() sets the viewport
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) { resolution.resize(width, height); }
+
+// each key moves the camera for as long as it was held during the frame,
+// the mouse and the wheel by their movement summed over the frame
+void apply_input() {
+  camera.on_keyboard_move(FORWARD, (float)input.held(GLFW_KEY_W));
+  camera.on_keyboard_move(BACKWARD, (float)input.held(GLFW_KEY_S));
+  camera.on_keyboard_move(LEFT, (float)input.held(GLFW_KEY_A));
+  camera.on_keyboard_move(RIGHT, (float)input.held(GLFW_KEY_D));
+  if (input.mouse_dx != 0.0 || input.mouse_dy != 0.0)
+    camera.on_mouse_move((float)input.mouse_dx, (float)input.mouse_dy);
+  if (input.scroll != 0.0)
+    camera.on_mouse_scroll((float)input.scroll);
+}
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode) {
   if (key == GLFW_KEY_ESCAPE)
     glfwSetWindowShouldClose(window, true);
-
-  if (action == GLFW_PRESS)
-    keys[key] = true;
-  else if (action == GLFW_RELEASE)
-    keys[key] = false;
-
-  if (keys[GLFW_KEY_W])
-    camera.on_keyboard_move(FORWARD, delta_time);
-  if (keys[GLFW_KEY_S])
-    camera.on_keyboard_move(BACKWARD, delta_time);
-  if (keys[GLFW_KEY_A])
-    camera.on_keyboard_move(LEFT, delta_time);
-  if (keys[GLFW_KEY_D])
-    camera.on_keyboard_move(RIGHT, delta_time);
+  input.key(key, action, glfwGetTime());
 }
 
-void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
-  if (first_mouse) {
-    last_x = xpos;
-    last_y = ypos;
-    first_mouse = false;
-  }
-
-  float xoffset = xpos - last_x;
-  float yoffset = ypos - last_y;
-  last_x = xpos;
-  last_y = ypos;
-
-  camera.on_mouse_move(xoffset, yoffset);
-}
+void mouse_callback(GLFWwindow *window, double xpos, double ypos) { input.cursor(xpos, ypos, glfwGetTime()); }
 
-void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) { camera.on_mouse_scroll(yoffset); }
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) { input.scroll_by(yoffset, glfwGetTime()); }
@@ -6,12 +6,25 @@
 
 #include <GLFW/glfw3.h>
 
+#include "platform.h"
+
+#include "entity_store.h"
+#include "fixed_timestep.h"
+#include "gl_resource.h"
+#include "instance_transforms.h"
+#include "job_system.h"
 #include "shader.h"
+#include "transforms.h"
+
+#include "texture.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 #include <iostream>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -20,65 +33,22 @@ void processInput(GLFWwindow *window);
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-unsigned int load_texture(const char *texture_file, GLenum format, bool flip) {
-  int width, height, nrChannels;
-
-  if (flip) {
-    stbi_set_flip_vertically_on_load(flip);
-  }
-
-  unsigned char *data = stbi_load(texture_file, &width, &height, &nrChannels, 0);
-
-  unsigned int texture;
-  glGenTextures(1, &texture);
-
-  glBindTexture(GL_TEXTURE_2D, texture);
-
-  if (data) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
-    std::cout << "Failed to load texture" << std::endl;
-  }
-  stbi_image_free(data);
-  return texture;
-}
-
-int main() {
-
-  // glfw: initialize and configure
-  // ------------------------------
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-  // glfw window creation
-  // --------------------
-  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+int main(int argc, char **argv) {
 
-  // glad: load all OpenGL function pointers
-  // ---------------------------------------
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    std::cout << "Failed to initialize GLAD" << std::endl;
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
     return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   }
 
-  Shader ourShader("learn_opengl/shaders/3.6.shader.vs", "learn_opengl/shaders/3.6.shader.fs");
+  Shader ourShader("learn_opengl/shaders/3.6.instanced.vs", "learn_opengl/shaders/3.6.shader.fs");
 
-  unsigned int texture1 = load_texture("learn_opengl/textures/container.jpg", GL_RGB, false);
-  unsigned int texture2 = load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true);
+  GlTexture texture1 = GlTexture::adopt(load_texture("learn_opengl/textures/container.jpg", GL_RGB, false));
+  GlTexture texture2 = GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true));
 
   // Set up vertex data (and buffer(s)) and configure vertex attributes
   // ------------------------------------------------------------------
@@ -110,17 +80,16 @@ int main() {
       1.0f, 0.0f, // lower-right corner
       0.5f, 1.0f  // top-center corner
   };
-  unsigned int VBO, VAO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+  GlBuffer EBO = GlBuffer::create();
 
-  glBindVertexArray(VAO);
+  glBindVertexArray(VAO.name());
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.name());
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
@@ -134,10 +103,10 @@ int main() {
   ourShader.use();
 
   glActiveTexture(GL_TEXTURE0); // default behavior
-  glBindTexture(GL_TEXTURE_2D, texture1);
+  glBindTexture(GL_TEXTURE_2D, texture1.name());
 
   glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, texture2);
+  glBindTexture(GL_TEXTURE_2D, texture2.name());
 
   ourShader.set_int("texture1", 0);
   ourShader.set_int("texture2", 1);
@@ -148,6 +117,38 @@ int main() {
                                glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
                                glm::vec3(1.5f, 0.2f, -1.5f),   glm::vec3(-1.3f, 1.0f, -1.5f)};
 
+  // the simulation: each cube keeps its own tilt and spins on top of it,
+  // advanced in fixed ticks (--tick-rate HZ, --max-ticks N)
+  EntityStore current, previous;
+  std::vector<glm::vec4> tilts;
+  for (unsigned int i = 0; i < 10; i++) {
+    EntityDesc cube;
+    cube.position = cubePositions[i];
+    current.add(cube);
+    tilts.push_back(axis_angle(glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(20.0f * i)));
+  }
+  auto simulate = [&](double time) {
+    glm::vec4 spin = axis_angle(glm::vec3(0.5f, 1.0f, 0.0f), (float)time * glm::radians(50.0f));
+    for (size_t i = 0; i < current.size(); i++) {
+      glm::vec4 rotation = quat_multiply(tilts[i], spin);
+      current.rotation_x[i] = rotation.x;
+      current.rotation_y[i] = rotation.y;
+      current.rotation_z[i] = rotation.z;
+      current.rotation_w[i] = rotation.w;
+    }
+  };
+  FixedTimestep timestep;
+  timestep.init(parse_timestep_options(argc, argv), platform.get_time());
+  simulate(0.0);
+  previous = current;
+  JobSystem jobs(0); // ten cubes, no worker threads
+
+  // what is drawn is a blend of the last two ticks, different every frame,
+  // so all of the cubes are dynamic and their matrices streamed
+  InstanceTransforms transforms;
+  transforms.init();
+  transforms.attach(VAO.name());
+
   glm::mat4 view = glm::mat4(1.0f);
   view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
 
@@ -162,43 +163,41 @@ int main() {
   unsigned int projectionLoc = glGetUniformLocation(ourShader.id, "projection");
   glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-  while (!glfwWindowShouldClose(window)) {
-    processInput(window);
+  while (!platform.should_close()) {
+    if (window)
+      processInput(window);
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // update the uniform color
-    float timeValue = glfwGetTime();
+    float timeValue = platform.get_time();
     float greenValue = sin(timeValue) / 2.0f + 0.5f;
     ourShader.set_float("ourColor", 0.0f, greenValue, 0.0f, 1.0f);
 
-    glBindVertexArray(VAO);
-
-    for (unsigned int i = 0; i < 10; i++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      model = glm::translate(model, cubePositions[i]);
-      float angle = 20.0f * i;
-      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0, 0.3f, 0.5f));
-
-      model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-
-      unsigned int modelLoc = glGetUniformLocation(ourShader.id, "model");
-      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-      // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    for (int ticks = timestep.advance(platform.get_time()); ticks > 0; ticks--) {
+      previous = current;
+      simulate(timestep.time() - (ticks - 1) * timestep.step);
     }
+    interpolate_entities(jobs, previous, current, (float)timestep.alpha, transforms.dynamics);
+    transforms.update();
+    transforms.draw(VAO.name(), 36);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    platform.swap_buffers();
+    platform.poll_events();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
+  timestep.report(std::cout);
+
+  VAO.reset();
+  VBO.reset();
+  EBO.reset();
+  texture1.reset();
+  texture2.reset();
+  transforms.destroy();
 
-  glfwTerminate();
+  gl_delete_queue().flush();
+  platform.terminate();
   return 0;
 }
 
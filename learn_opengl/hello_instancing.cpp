@@ -0,0 +1,284 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#define ALLOCATION_COUNTER_IMPLEMENTATION
+#include "allocation_counter.h"
+
+#include "camera.h"
+#include "culling.h"
+#include "entity_store.h"
+#include "frame_arena.h"
+#include "gl_resource.h"
+#include "job_system.h"
+#include "sampler.h"
+#include "shader.h"
+#include "transforms.h"
+
+#include "data0.h"
+
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void mouse_callback(GLFWwindow *window, double xpos, double ypos);
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void processInput(GLFWwindow *window, float delta_time);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+bool first_mouse = true;
+float last_x = SCR_WIDTH / 2.0f, last_y = SCR_HEIGHT / 2.0f;
+int fb_width = SCR_WIDTH, fb_height = SCR_HEIGHT;
+
+Camera camera;
+
+double clock_ms() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a block of spinning cubes kept in an EntityStore; every frame they are
+// spun, culled against the view frustum and the visible ones' world matrices
+// written on all cores straight into the mapped instance buffer, one
+// instanced draw per material; --compact sends position, scale and a
+// quantized quaternion (24 bytes) instead of the matrix (64 bytes)
+//
+// usage: hello_instancing [--instances N] [--threads N] [--compact] [--camera-path] [platform flags]
+int main(int argc, char **argv) {
+  size_t count = 100000;
+  int workers = -1;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--instances") == 0)
+      count = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--threads") == 0)
+      workers = atoi(argv[++i]) - 1;
+  }
+  bool compact = has_flag(argc, argv, "--compact");
+  size_t instance_size = compact ? sizeof(CompactInstance) : sizeof(glm::mat4);
+
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+  }
+
+  Shader shader(compact ? "learn_opengl/shaders/3.6.compact.vs" : "learn_opengl/shaders/3.6.instanced.vs",
+                "learn_opengl/shaders/3.6.shader.fs");
+  GlTexture textures[] = {
+      GlTexture::adopt(load_texture("learn_opengl/textures/container.jpg", GL_RGB, false)),
+      GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true)),
+  };
+
+  // the scene: a cube of cubes, each starting at its own angle; material 1
+  // swaps the two textures
+  const int MATERIALS = 2;
+  const glm::vec3 axis(1.0f, 0.3f, 0.5f);
+  int side = (int)std::ceil(std::cbrt((double)count));
+  EntityStore store;
+  store.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 cell(i % side, (i / side) % side, i / ((size_t)side * side));
+    EntityDesc cube;
+    cube.position = (cell - glm::vec3(side / 2.0f)) * 2.0f;
+    cube.rotation = axis_angle(axis, glm::radians(20.0f * (i % 18)));
+    cube.material = (uint32_t)(i % MATERIALS);
+    store.add(cube);
+  }
+  camera.pos = glm::vec3(0.0f, 0.0f, side * 2.0f);
+
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+  GlBuffer instance_buffer = GlBuffer::create();
+
+  glBindVertexArray(VAO.name());
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // one mat4 per instance in attributes 2-5 or a compact instance in 2 and
+  // 3, pointed at each material's range before its draw
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer.name());
+  glBufferData(GL_ARRAY_BUFFER, count * instance_size, NULL, GL_STREAM_DRAW);
+  for (int location = 2; location < (compact ? 4 : 6); location++) {
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+
+  shader.use();
+  shader.set_int("texture1", 0);
+  shader.set_int("texture2", 1);
+
+  SamplerCache samplers;
+  samplers.bind(0, SamplerDesc());
+  samplers.bind(1, SamplerDesc());
+
+  glEnable(GL_DEPTH_TEST);
+
+  JobSystem jobs(workers);
+  std::cout << count << " instances of " << instance_size << " bytes, " << jobs.thread_count() << " threads"
+            << std::endl;
+
+  // --camera-path replaces mouse and keys with a scripted fly-through
+  bool camera_path = has_flag(argc, argv, "--camera-path");
+
+  double last_frame = platform.get_time();
+  double last_report = clock_ms(), cull_total = 0.0, update_total = 0.0;
+  size_t visible_total = 0, allocations = allocation_count();
+  long update_frames = 0;
+  while (!platform.should_close()) {
+    next_arena_frame(); // last frame's transient data is dead
+    platform.poll_events();
+    double current_frame = platform.get_time();
+    float delta_time = (float)(current_frame - last_frame);
+    last_frame = current_frame;
+    if (window)
+      processInput(window, delta_time);
+    if (camera_path)
+      camera.follow_path((float)current_frame);
+
+    float aspect = fb_height > 0 ? (float)fb_width / fb_height : 1.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(camera.fov), aspect, 0.1f, 1000.0f);
+    glm::mat4 view = camera.get_view();
+
+    double cull_start = clock_ms();
+    spin_entities(jobs, store, axis_angle(axis, delta_time));
+    visible_total += cull_entities(jobs, store, projection * view);
+
+    // invalidating lets the driver hand out fresh memory instead of waiting
+    // for the previous frame's draw to finish with it
+    double update_start = clock_ms();
+    size_t drawn[MATERIALS] = {};
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer.name());
+    void *instances = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * instance_size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (instances) {
+      for (int material = 0, written = 0; material < MATERIALS; written += (int)drawn[material++])
+        drawn[material] = compact ? write_visible_compact(jobs, store, material, (CompactInstance *)instances + written)
+                                  : write_visible_transforms(jobs, store, material, (glm::mat4 *)instances + written);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    cull_total += update_start - cull_start;
+    update_total += clock_ms() - update_start;
+    update_frames++;
+
+    glViewport(0, 0, fb_width, fb_height);
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    shader.set_mat4("projection", projection);
+    shader.set_mat4("view", view);
+    glBindVertexArray(VAO.name());
+    for (size_t material = 0, first = 0; material < MATERIALS; first += drawn[material++]) {
+      if (drawn[material] == 0)
+        continue;
+      for (int unit = 0; unit < 2; unit++) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, textures[(unit + material) % 2].name());
+      }
+      // no base instance in GL 3.3, the attributes move to the range instead
+      if (compact)
+        compact_instance_attributes(first * sizeof(CompactInstance));
+      else
+        for (int column = 0; column < 4; column++)
+          glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                (void *)(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)drawn[material]);
+    }
+
+    platform.swap_buffers();
+
+    double now = clock_ms();
+    if (now - last_report > 1000.0) {
+      size_t visible = visible_total / update_frames;
+      std::cout << visible << " of " << count << " instances visible, spin and cull " << cull_total / update_frames
+                << " ms, transform update " << update_total / update_frames << " ms ("
+                << visible / (update_total / update_frames) / 1000.0 << " M/s), "
+                << (double)(allocation_count() - allocations) / update_frames << " heap allocations per frame"
+                << std::endl;
+      allocations = allocation_count();
+      last_report = now;
+      cull_total = update_total = 0.0;
+      visible_total = 0;
+      update_frames = 0;
+    }
+  }
+
+  VAO.reset();
+  VBO.reset();
+  instance_buffer.reset();
+  for (GlTexture &texture : textures)
+    texture.reset();
+  glDeleteProgram(shader.id);
+  samplers.destroy();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
+
+void processInput(GLFWwindow *window, float delta_time) {
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    camera.on_keyboard_move(FORWARD, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    camera.on_keyboard_move(BACKWARD, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    camera.on_keyboard_move(LEFT, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    camera.on_keyboard_move(RIGHT, delta_time);
+}
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
+  fb_width = width;
+  fb_height = height;
+}
+
+void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
+  if (first_mouse) {
+    last_x = xpos;
+    last_y = ypos;
+    first_mouse = false;
+  }
+
+  float xoffset = xpos - last_x;
+  float yoffset = ypos - last_y;
+  last_x = xpos;
+  last_y = ypos;
+
+  camera.on_mouse_move(xoffset, yoffset);
+}
+
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) { camera.on_mouse_scroll(yoffset); }
@@ -0,0 +1,141 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#include "gl_resource.h"
+#include "render_queue.h"
+#include "sampler.h"
+#include "shader.h"
+
+#include "data0.h"
+
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <iostream>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+const int GRID = 12;
+
+RenderQueue queue;
+
+// a grid of cubes with materials interleaved in code order, the worst case for
+// immediate submission; press S to toggle sorting and compare the counts
+int main(int argc, char **argv) {
+
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+  }
+
+  // two programs standing in for two material shaders
+  Shader shaders[] = {
+      Shader("learn_opengl/shaders/3.6.shader.vs", "learn_opengl/shaders/3.6.shader.fs"),
+      Shader("learn_opengl/shaders/3.6.shader.vs", "learn_opengl/shaders/3.5.shader.fs"),
+  };
+
+  GlTexture container = GlTexture::adopt(load_texture("learn_opengl/textures/container.jpg", GL_RGB, false));
+  GlTexture face = GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true));
+  unsigned int materials[][2] = {
+      {container.name(), face.name()}, {face.name(), container.name()}, {container.name(), container.name()}};
+
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+
+  glBindVertexArray(VAO.name());
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 22.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+  for (Shader &shader : shaders) {
+    shader.use();
+    shader.set_int("texture1", 0);
+    shader.set_int("texture2", 1);
+  }
+
+  SamplerCache samplers;
+  samplers.bind(0, SamplerDesc());
+  samplers.bind(1, SamplerDesc());
+
+  glEnable(GL_DEPTH_TEST);
+
+  double last_report = platform.get_time();
+  while (!platform.should_close()) {
+    next_arena_frame();
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    float time = (float)platform.get_time();
+    queue.begin_frame(view, projection);
+    for (int i = 0; i < GRID * GRID; i++) {
+      glm::vec3 position((i % GRID - (GRID - 1) / 2.0f) * 1.6f, (i / GRID - (GRID - 1) / 2.0f) * 1.6f, 0.0f);
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+      model = glm::rotate(model, time + 0.1f * i, glm::vec3(1.0f, 0.3f, 0.5f));
+      queue.draw(0, shaders[i % 2].id, VAO.name(), materials[i % 3], 2, GL_TRIANGLES, 0, 36, model);
+    }
+    queue.submit();
+
+    if (platform.get_time() - last_report > 1.0) {
+      last_report = platform.get_time();
+      std::cout << (queue.sorting ? "sorted" : "unsorted") << ": " << queue.submitted.draws << " draws, state changes "
+                << queue.recorded.state_changes() << " in code order -> " << queue.submitted.state_changes()
+                << " submitted (program " << queue.submitted.program_changes << ", texture "
+                << queue.submitted.texture_changes << ", vao " << queue.submitted.vao_changes << ")" << std::endl;
+    }
+
+    platform.swap_buffers();
+    platform.poll_events();
+  }
+
+  VAO.reset();
+  VBO.reset();
+  container.reset();
+  face.reset();
+  for (Shader &shader : shaders)
+    glDeleteProgram(shader.id);
+  samplers.destroy();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
+
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode) {
+  if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+  if (key == GLFW_KEY_S && action == GLFW_PRESS)
+    queue.sorting = !queue.sorting;
+}
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) { glViewport(0, 0, width, height); }
@@ -0,0 +1,199 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#include "camera.h"
+#include "gl_resource.h"
+#include "render_thread.h"
+#include "sampler.h"
+#include "shader.h"
+
+#include "data0.h"
+
+#include "texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cmath>
+#include <iostream>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void mouse_callback(GLFWwindow *window, double xpos, double ypos);
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void processInput(GLFWwindow *window, float delta_time);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+// enough cubes that the matrix work on the main thread is worth overlapping
+const int GRID = 10;
+
+bool first_mouse = true;
+float last_x = SCR_WIDTH / 2.0f, last_y = SCR_HEIGHT / 2.0f;
+int fb_width = SCR_WIDTH, fb_height = SCR_HEIGHT;
+
+Camera camera;
+
+// hello_camera with a field of spinning cubes, the main thread polls input and
+// records frame N+1 while the render thread submits frame N
+int main(int argc, char **argv) {
+
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+  }
+
+  // all GL setup happens before the context moves to the render thread
+  Shader shader("learn_opengl/shaders/3.6.shader.vs", "learn_opengl/shaders/3.6.shader.fs");
+  GlTexture textures[] = {
+      GlTexture::adopt(load_texture("learn_opengl/textures/container.jpg", GL_RGB, false)),
+      GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true)),
+  };
+  // what the render thread binds, it never touches the wrappers
+  unsigned int texture_names[] = {textures[0].name(), textures[1].name()};
+
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+
+  glBindVertexArray(VAO.name());
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  shader.use();
+  shader.set_int("texture1", 0);
+  shader.set_int("texture2", 1);
+
+  SamplerCache samplers;
+  samplers.bind(0, SamplerDesc());
+  samplers.bind(1, SamplerDesc());
+
+  glEnable(GL_DEPTH_TEST);
+
+  // --camera-path replaces mouse and keys with a scripted fly-through
+  bool camera_path = has_flag(argc, argv, "--camera-path");
+
+  RenderThread renderer;
+  renderer.start(&platform);
+
+  long frame_index = 0;
+  double last_frame = platform.get_time();
+  double last_report = render_clock_ms();
+  long last_presented = 0;
+  while (!platform.should_close()) {
+    next_arena_frame();
+    platform.poll_events();
+    double input_time = render_clock_ms();
+
+    // headless time follows the recorded frames, the presented count lags
+    double current_frame = platform.headless() ? frame_index / 60.0 : platform.get_time();
+    float delta_time = (float)(current_frame - last_frame);
+    last_frame = current_frame;
+    if (window)
+      processInput(window, delta_time);
+    if (camera_path)
+      camera.follow_path((float)current_frame);
+
+    RenderFrame &frame = renderer.begin_frame();
+    frame.input_time = input_time;
+    frame.index = frame_index++;
+    frame.viewport_width = fb_width;
+    frame.viewport_height = fb_height;
+
+    float aspect = fb_height > 0 ? (float)fb_width / fb_height : 1.0f;
+    frame.queue.begin_frame(camera.get_view(),
+                            glm::perspective(glm::radians(camera.fov), aspect, 0.1f, 1000.0f));
+    for (int i = 0; i < GRID * GRID * GRID; i++) {
+      glm::vec3 position(i % GRID, (i / GRID) % GRID, i / (GRID * GRID));
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), position * 2.0f - glm::vec3(GRID, GRID, 2 * GRID));
+      model = glm::rotate(model, (float)current_frame + 0.1f * i, glm::vec3(1.0f, 0.3f, 0.5f));
+      frame.queue.draw(0, shader.id, VAO.name(), texture_names, 2, GL_TRIANGLES, 0, 36, model);
+    }
+    renderer.end_frame();
+
+    double now = render_clock_ms();
+    if (now - last_report > 1000.0) {
+      long presented = renderer.frames_presented();
+      ProfileStats latency = renderer.latency_stats();
+      std::cout << (presented - last_presented) * 1000.0 / (now - last_report) << " fps, input latency min "
+                << latency.min << " avg " << latency.avg << " p99 " << latency.p99 << " ms" << std::endl;
+      last_report = now;
+      last_presented = presented;
+    }
+  }
+  renderer.stop();
+
+  VAO.reset();
+  VBO.reset();
+  for (GlTexture &texture : textures)
+    texture.reset();
+  glDeleteProgram(shader.id);
+  samplers.destroy();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
+
+void processInput(GLFWwindow *window, float delta_time) {
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    camera.on_keyboard_move(FORWARD, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    camera.on_keyboard_move(BACKWARD, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    camera.on_keyboard_move(LEFT, delta_time);
+  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    camera.on_keyboard_move(RIGHT, delta_time);
+}
+
+// runs on the main thread inside poll_events(), the render thread picks the
+// new size up with the next frame
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
+  fb_width = width;
+  fb_height = height;
+}
+
+void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
+  if (first_mouse) {
+    last_x = xpos;
+    last_y = ypos;
+    first_mouse = false;
+  }
+
+  float xoffset = xpos - last_x;
+  float yoffset = ypos - last_y;
+  last_x = xpos;
+  last_y = ypos;
+
+  camera.on_mouse_move(xoffset, yoffset);
+}
+
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) { camera.on_mouse_scroll(yoffset); }
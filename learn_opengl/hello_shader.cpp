@@ -2,6 +2,12 @@
 
 #include <GLFW/glfw3.h>
 
+#include "platform.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "gl_resource.h"
 #include "shader.h"
 
 #include <iostream>
@@ -13,35 +19,16 @@ void processInput(GLFWwindow *window);
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-int main() {
-
-  // glfw: initialize and configure
-  // ------------------------------
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-  // glfw window creation
-  // --------------------
-  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-  if (window == NULL) {
-    std::cout << "Failed to create GLFW window" << std::endl;
-    glfwTerminate();
-    return -1;
-  }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+int main(int argc, char **argv) {
 
-  // glad: load all OpenGL function pointers
-  // ---------------------------------------
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    std::cout << "Failed to initialize GLAD" << std::endl;
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
     return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   }
 
   Shader ourShader("learn_opengl/shaders/3.3.shader.vs", "learn_opengl/shaders/3.3.shader.fs");
@@ -59,17 +46,16 @@ int main() {
       0, 1, 3, // first Triangle
       1, 2, 3  // second Triangle
   };
-  unsigned int VBO, VAO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+  GlBuffer EBO = GlBuffer::create();
 
-  glBindVertexArray(VAO);
+  glBindVertexArray(VAO.name());
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.name());
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
@@ -77,8 +63,9 @@ int main() {
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  while (!glfwWindowShouldClose(window)) {
-    processInput(window);
+  while (!platform.should_close()) {
+    if (window)
+      processInput(window);
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -86,21 +73,21 @@ int main() {
     ourShader.use();
 
     // update the uniform color
-    float timeValue = glfwGetTime();
+    float timeValue = platform.get_time();
     float greenValue = sin(timeValue) / 2.0f + 0.5f;
     ourShader.set_float("ourColor", 0.0f, greenValue, 0.0f, 1.0f);
 
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    platform.swap_buffers();
+    platform.poll_events();
   }
 
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteBuffers(1, &EBO);
-
-  glfwTerminate();
+  VAO.reset();
+  VBO.reset();
+  EBO.reset();
+  gl_delete_queue().flush();
+  platform.terminate();
   return 0;
 }
 
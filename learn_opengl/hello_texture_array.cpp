@@ -0,0 +1,139 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#include "gl_resource.h"
+#include "sampler.h"
+#include "shader.h"
+
+#include "data0.h"
+
+#include "texture_packing.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <iostream>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void processInput(GLFWwindow *window);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+int main(int argc, char **argv) {
+
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  }
+
+  Shader shader("learn_opengl/shaders/3.7.shader.vs", "learn_opengl/shaders/3.7.shader.fs");
+
+  // both images are 512x512, forced to RGBA they end up as two layers of the
+  // same array texture
+  TexturePacker packer;
+  int materials[] = {
+      packer.add("learn_opengl/textures/container.jpg", false),
+      packer.add("learn_opengl/textures/awesomeface.png", true),
+  };
+  packer.build();
+
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+
+  glBindVertexArray(VAO.name());
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  shader.use();
+  shader.set_int("textures", 0);
+
+  // the only texture bind of the whole program
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, packer.get(materials[0]).texture);
+
+  SamplerCache samplers;
+  SamplerDesc clamped;
+  clamped.wrap_s = clamped.wrap_t = clamped.wrap_r = GL_CLAMP_TO_EDGE;
+  samplers.bind(0, clamped);
+
+  glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+  shader.set_mat4("view", view);
+  shader.set_mat4("projection", projection);
+
+  int layer_loc = glGetUniformLocation(shader.id, "layer");
+  int uv_rect_loc = glGetUniformLocation(shader.id, "uv_rect");
+  int model_loc = glGetUniformLocation(shader.id, "model");
+
+  glEnable(GL_DEPTH_TEST);
+
+  while (!platform.should_close()) {
+    if (window)
+      processInput(window);
+
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glBindVertexArray(VAO.name());
+
+    for (unsigned int i = 0; i < 10; i++) {
+      glm::mat4 model = glm::mat4(1.0f);
+      model = glm::translate(model, cube_positions[i]);
+      float angle = 20.0f * i;
+      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0, 0.3f, 0.5f));
+      model = glm::rotate(model, (float)platform.get_time() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
+      glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
+
+      // switching material is a uniform update, not a texture bind
+      const PackedTexture &material = packer.get(materials[i % 2]);
+      glUniform1f(layer_loc, (float)material.layer);
+      glUniform4fv(uv_rect_loc, 1, glm::value_ptr(material.uv_rect));
+
+      glDrawArrays(GL_TRIANGLES, 0, 36);
+    }
+
+    platform.swap_buffers();
+    platform.poll_events();
+  }
+
+  VAO.reset();
+  VBO.reset();
+  packer.destroy();
+  samplers.destroy();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
+
+void processInput(GLFWwindow *window) {
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+}
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) { glViewport(0, 0, width, height); }
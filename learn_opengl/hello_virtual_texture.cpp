@@ -0,0 +1,216 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include "platform.h"
+
+#include "gl_resource.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "shader.h"
+
+#include "data0.h"
+
+#include "texture.h"
+#include "virtual_texture.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void processInput(GLFWwindow *window);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+// the feedback pass runs at 1/FEEDBACK_SCALE of the window resolution
+const int FEEDBACK_SCALE = 4;
+
+int fb_width = SCR_WIDTH, fb_height = SCR_HEIGHT;
+
+void set_virtual_uniforms(Shader &shader, const VirtualTexture &vt) {
+  shader.use();
+  glUniform2f(glGetUniformLocation(shader.id, "virtual_size"), (float)vt.width, (float)vt.height);
+  shader.set_float("tile_size", (float)vt.tile_size);
+  shader.set_float("border", (float)vt.border);
+  shader.set_float("max_level", (float)(vt.levels - 1));
+}
+
+// usage: hello_virtual_texture [texture.cgvt] [--headless ...]
+//
+// without an argument container.jpg is baked into a small virtual texture with
+// 64x64 pages and streamed through a deliberately small 8x8 page cache
+int main(int argc, char **argv) {
+
+  bool baked = argc <= 1 || argv[1][0] == '-';
+  const char *vt_path = baked ? "container.cgvt" : argv[1];
+  if (baked && !std::ifstream(vt_path).good()) {
+    Image image;
+    if (!load_image("learn_opengl/textures/container.jpg", false, 4, image) ||
+        !write_virtual_texture(vt_path, image, 64))
+      return -1;
+  }
+
+  // window or headless EGL context, see platform.h for the flags
+  // ------------------------------------------------------------
+  Platform platform;
+  if (!platform.init(argc, argv, SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL"))
+    return -1;
+  GLFWwindow *window = platform.window;
+  if (window) {
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwGetFramebufferSize(window, &fb_width, &fb_height);
+  }
+
+  Shader shader("learn_opengl/shaders/3.8.vt.vs", "learn_opengl/shaders/3.8.vt.fs");
+  Shader feedback("learn_opengl/shaders/3.8.vt.vs", "learn_opengl/shaders/3.8.vt_feedback.fs");
+
+  VirtualTexture vt;
+  if (!vt.open(vt_path, baked ? 8 : 16)) {
+    std::cout << "Failed to open virtual texture " << vt_path << std::endl;
+    platform.terminate();
+    return -1;
+  }
+  std::cout << "virtual texture " << vt.width << "x" << vt.height << ", " << vt.levels << " levels, "
+            << (vt.sparse_supported ? "ARB_sparse_texture available, " : "") << "software page table" << std::endl;
+
+  GlTexture texture2 = GlTexture::adopt(load_texture("learn_opengl/textures/awesomeface.png", GL_RGBA, true));
+
+  GlVertexArray VAO = GlVertexArray::create();
+  GlBuffer VBO = GlBuffer::create();
+
+  glBindVertexArray(VAO.name());
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO.name());
+  glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(0));
+  glEnableVertexAttribArray(0);
+
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // units: 0 physical cache, 1 page table, 2 awesomeface
+  vt.bind(0, 1);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, texture2.name());
+
+  SamplerCache samplers;
+  SamplerDesc cache_sampler;
+  cache_sampler.min_filter = GL_LINEAR;
+  cache_sampler.wrap_s = cache_sampler.wrap_t = GL_CLAMP_TO_EDGE;
+  SamplerDesc page_table_sampler;
+  page_table_sampler.min_filter = page_table_sampler.mag_filter = GL_NEAREST;
+  samplers.bind(0, cache_sampler);
+  samplers.bind(1, page_table_sampler);
+  samplers.bind(2, SamplerDesc());
+
+  set_virtual_uniforms(shader, vt);
+  shader.set_int("cache", 0);
+  shader.set_int("page_table", 1);
+  shader.set_int("texture2", 2);
+
+  set_virtual_uniforms(feedback, vt);
+  feedback.set_float("lod_bias", std::log2((float)FEEDBACK_SCALE));
+
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+
+  glEnable(GL_DEPTH_TEST);
+
+  PROFILE_START_TRACE();
+  double last_report = platform.get_time();
+  while (!platform.should_close()) {
+    if (window)
+      processInput(window);
+
+    PROFILE_BEGIN_FRAME();
+
+    // stream pages requested by the previous frame's feedback
+    {
+      PROFILE_SCOPE("vt_update");
+      vt.update();
+    }
+
+    // dolly in and out so the requested levels keep changing
+    float time = (float)platform.get_time();
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -6.0f + 4.5f * std::sin(time * 0.5f)));
+
+    glBindVertexArray(VAO.name());
+
+    for (int pass = 0; pass < 2; pass++) {
+      PROFILE_SCOPE(pass == 0 ? "feedback" : "shade");
+      Shader &current = pass == 0 ? feedback : shader;
+      if (pass == 0) {
+        vt.begin_feedback(fb_width / FEEDBACK_SCALE, fb_height / FEEDBACK_SCALE);
+      } else {
+        glViewport(0, 0, fb_width, fb_height);
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      }
+
+      current.use();
+      current.set_mat4("projection", projection);
+      current.set_mat4("view", view);
+
+      for (unsigned int i = 0; i < 10; i++) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cube_positions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0, 0.3f, 0.5f));
+        current.set_mat4("model", model);
+
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+      }
+
+      if (pass == 0)
+        vt.end_feedback();
+    }
+    PROFILE_END_FRAME();
+
+    if (platform.get_time() - last_report > 1.0) {
+      last_report = platform.get_time();
+      std::cout << "pages requested " << vt.stats.requested << ", resident " << vt.stats.resident << ", uploaded "
+                << vt.stats.uploads << ", evicted " << vt.stats.evictions << std::endl;
+    }
+
+    platform.swap_buffers();
+    platform.poll_events();
+  }
+
+  PROFILE_REPORT(std::cout);
+  PROFILE_WRITE_TRACE("hello_virtual_texture.trace.json");
+  PROFILE_SHUTDOWN();
+
+  VAO.reset();
+  VBO.reset();
+  texture2.reset();
+  vt.destroy();
+  samplers.destroy();
+
+  gl_delete_queue().flush();
+  platform.terminate();
+  return 0;
+}
+
+void processInput(GLFWwindow *window) {
+  if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    glfwSetWindowShouldClose(window, true);
+}
+
+void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
+  fb_width = width;
+  fb_height = height;
+  glViewport(0, 0, width, height);
+}
@@ -0,0 +1,146 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <cstddef>
+
+enum InputEventType { INPUT_KEY, INPUT_CURSOR, INPUT_SCROLL };
+
+struct InputEvent {
+  InputEventType type;
+  double time; // glfwGetTime() when the callback ran
+  int key;     // INPUT_KEY
+  int action;  // INPUT_KEY: GLFW_PRESS or GLFW_RELEASE
+  double x, y; // INPUT_CURSOR: position, INPUT_SCROLL: offset
+};
+
+// input events queued by the GLFW callbacks and applied once per frame
+//
+//   void key_callback(...)  { input.key(key, action, glfwGetTime()); }
+//   ...
+//   platform.poll_events();
+//   input.update(platform.get_time());
+//   camera.on_keyboard_move(FORWARD, input.held(GLFW_KEY_W));
+//
+// The callbacks only append to a single-producer single-consumer ring, so
+// they cost a few stores each and may run on another thread than the
+// frame. update() drains the events up to the frame's time: a key's held()
+// is how long it was down within the frame, from the timestamps of its
+// press and release, so movement integrated from it is the same at any
+// frame rate and whatever the key repeat rate. Cursor moves and scrolling
+// are summed into one delta per frame however many events arrive.
+class Input {
+public:
+  static const size_t CAPACITY = 1024; // power of two
+  static const int KEY_COUNT = GLFW_KEY_LAST + 1;
+
+  // per frame, written by update()
+  double mouse_dx = 0.0, mouse_dy = 0.0; // cursor movement, y grows downwards
+  double scroll = 0.0;
+  size_t events = 0; // events applied by the last update()
+
+  // producer side, from the callbacks; key repeats carry no information and
+  // are not queued
+  void key(int key, int action, double time) {
+    if (key >= 0 && key < KEY_COUNT && action != GLFW_REPEAT)
+      push({INPUT_KEY, time, key, action, 0.0, 0.0});
+  }
+  void cursor(double x, double y, double time) { push({INPUT_CURSOR, time, 0, 0, x, y}); }
+  void scroll_by(double offset, double time) { push({INPUT_SCROLL, time, 0, 0, 0.0, offset}); }
+
+  // events lost to a full ring; a key release among them leaves the key down
+  // until the next press and release
+  size_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+  // consumer side: apply the events up to `now`, later ones wait for the
+  // next frame
+  void update(double now) {
+    double frame_start = last_update < now ? last_update : now;
+    for (int k = 0; k < KEY_COUNT; k++) {
+      held_time[k] = 0.0;
+      went_down[k] = false;
+      down_since[k] = frame_start;
+    }
+    mouse_dx = mouse_dy = scroll = 0.0;
+    events = 0;
+
+    InputEvent event;
+    while (peek(event) && event.time <= now) {
+      pop();
+      events++;
+      double time = event.time < frame_start ? frame_start : event.time;
+      switch (event.type) {
+      case INPUT_KEY:
+        if (event.action == GLFW_PRESS && !is_down[event.key]) {
+          is_down[event.key] = true;
+          went_down[event.key] = true;
+          down_since[event.key] = time;
+        } else if (event.action == GLFW_RELEASE && is_down[event.key]) {
+          is_down[event.key] = false;
+          held_time[event.key] += time - down_since[event.key];
+        }
+        break;
+      case INPUT_CURSOR:
+        if (has_cursor) {
+          mouse_dx += event.x - cursor_x;
+          mouse_dy += event.y - cursor_y;
+        }
+        cursor_x = event.x;
+        cursor_y = event.y;
+        has_cursor = true;
+        break;
+      case INPUT_SCROLL:
+        scroll += event.y;
+        break;
+      }
+    }
+    for (int k = 0; k < KEY_COUNT; k++)
+      if (is_down[k])
+        held_time[k] += now - down_since[k];
+    last_update = now;
+  }
+
+  // seconds the key was down during the last frame
+  double held(int key) const { return key >= 0 && key < KEY_COUNT ? held_time[key] : 0.0; }
+  bool down(int key) const { return key >= 0 && key < KEY_COUNT && is_down[key]; }
+  // went down during the last frame
+  bool pressed(int key) const { return key >= 0 && key < KEY_COUNT && went_down[key]; }
+
+private:
+  InputEvent ring[CAPACITY];
+  std::atomic<size_t> head{0}; // next slot the producer writes
+  std::atomic<size_t> tail{0}; // next slot the consumer reads
+  std::atomic<size_t> lost{0};
+
+  bool is_down[KEY_COUNT] = {};
+  bool went_down[KEY_COUNT] = {};
+  double held_time[KEY_COUNT] = {};
+  double down_since[KEY_COUNT] = {};
+  double last_update = 0.0;
+  double cursor_x = 0.0, cursor_y = 0.0;
+  bool has_cursor = false;
+
+  void push(const InputEvent &event) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == CAPACITY) {
+      lost.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ring[h % CAPACITY] = event;
+    head.store(h + 1, std::memory_order_release); // publishes the event
+  }
+
+  bool peek(InputEvent &event) const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false;
+    event = ring[t % CAPACITY];
+    return true;
+  }
+
+  void pop() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
+
+#endif // INPUT_H
@@ -0,0 +1,145 @@
+#ifndef INSTANCE_TRANSFORMS_H
+#define INSTANCE_TRANSFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "batch_math.h"
+#include "entity_store.h"
+#include "gl_resource.h"
+#include "gpu_memory.h"
+
+#include <cstddef>
+#include <vector>
+
+// an instance and which of the two stores it lives in
+struct InstanceHandle {
+  EntityHandle entity;
+  bool dynamic;
+};
+
+// world matrices of a scene's instances in GPU buffers, split by whether
+// the instances move
+//
+// Static instances' matrices are computed and uploaded once and stay
+// resident; they are only rebuilt after invalidate_statics(). Dynamic ones
+// are recomputed and streamed every frame. A frame therefore costs the
+// moving instances, however many static ones there are. Both sets are
+// drawn instanced with the matrix in attributes 2-5, see
+// shaders/3.6.instanced.vs:
+//
+//   transforms.init();
+//   transforms.attach(VAO);
+//   transforms.add(desc, false);  // or true for one that moves
+//   ...
+//   // per frame: write dynamics' arrays, then
+//   transforms.update();
+//   transforms.draw(VAO, 36);
+//   ...
+//   transforms.destroy(); // the buffers go through gl_delete_queue()
+class InstanceTransforms {
+public:
+  EntityStore statics;  // write through them, then invalidate_statics()
+  EntityStore dynamics; // write through them freely
+  GlBuffer static_buffer, dynamic_buffer;
+
+  size_t static_uploads = 0; // times the static matrices were rebuilt
+  size_t last_computed = 0;  // matrices the last update() computed
+
+  void init() {
+    static_buffer = GlBuffer::create();
+    dynamic_buffer = GlBuffer::create();
+  }
+
+  // enable the instance attributes of a vertex array object; draw() points
+  // them at the buffers
+  void attach(unsigned int vao) const {
+    glBindVertexArray(vao);
+    for (int column = 0; column < 4; column++) {
+      glEnableVertexAttribArray(2 + column);
+      glVertexAttribDivisor(2 + column, 1);
+    }
+  }
+
+  InstanceHandle add(const EntityDesc &desc, bool dynamic) {
+    InstanceHandle handle = {dynamic ? dynamics.add(desc) : statics.add(desc), dynamic};
+    if (!dynamic)
+      static_dirty = true;
+    return handle;
+  }
+
+  bool remove(InstanceHandle handle) {
+    if (handle.dynamic)
+      return dynamics.remove(handle.entity);
+    if (!statics.remove(handle.entity))
+      return false;
+    static_dirty = true;
+    return true;
+  }
+
+  void invalidate_statics() { static_dirty = true; }
+
+  // rebuild the static matrices if they changed and stream the dynamic ones
+  void update() {
+    last_computed = 0;
+    if (static_dirty) {
+      std::vector<glm::mat4> models(statics.size());
+      batch_model_matrices(statics, 0, statics.size(), models.data());
+      glBindBuffer(GL_ARRAY_BUFFER, static_buffer.name());
+      tracked_buffer_data(GL_ARRAY_BUFFER, static_buffer.name(), models.size() * sizeof(glm::mat4), models.data(),
+                          GL_STATIC_DRAW, "instances");
+      static_dirty = false;
+      static_uploads++;
+      last_computed += models.size();
+    }
+
+    size_t count = dynamics.size();
+    if (count == 0)
+      return;
+    glBindBuffer(GL_ARRAY_BUFFER, dynamic_buffer.name());
+    if (count > dynamic_capacity) {
+      dynamic_capacity = count + count / 2;
+      tracked_buffer_data(GL_ARRAY_BUFFER, dynamic_buffer.name(), dynamic_capacity * sizeof(glm::mat4), NULL,
+                          GL_STREAM_DRAW, "instances");
+    }
+    // invalidating lets the driver hand out fresh memory instead of waiting
+    // for the previous frame's draw to finish with it
+    glm::mat4 *models = (glm::mat4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4),
+                                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!models)
+      return;
+    batch_model_matrices(dynamics, 0, count, models);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    last_computed += count;
+  }
+
+  // one instanced draw per non-empty set, `vao` attached; `first_vertex` is
+  // the mesh's base vertex when it lives in a BufferPool
+  void draw(unsigned int vao, int vertex_count, int first_vertex = 0) const {
+    glBindVertexArray(vao);
+    draw_set(static_buffer.name(), statics.size(), first_vertex, vertex_count);
+    draw_set(dynamic_buffer.name(), dynamics.size(), first_vertex, vertex_count);
+  }
+
+  // retired, so they go once the frames drawing from them are done
+  void destroy() {
+    static_buffer.reset();
+    dynamic_buffer.reset();
+    dynamic_capacity = 0;
+  }
+
+private:
+  bool static_dirty = false;
+  size_t dynamic_capacity = 0;
+
+  static void draw_set(unsigned int buffer, size_t count, int first_vertex, int vertex_count) {
+    if (count == 0)
+      return;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int column = 0; column < 4; column++)
+      glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(column * sizeof(glm::vec4)));
+    glDrawArraysInstanced(GL_TRIANGLES, first_vertex, vertex_count, (GLsizei)count);
+  }
+};
+
+#endif // INSTANCE_TRANSFORMS_H
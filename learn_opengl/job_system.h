@@ -0,0 +1,183 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a range of work, `function(context, begin, end)`
+struct Job {
+  void (*function)(const void *context, size_t begin, size_t end);
+  const void *context;
+  size_t begin;
+  size_t end;
+  std::atomic<size_t> *pending; // jobs of the batch not finished yet
+};
+
+// worker threads with one job deque each; a thread takes work from the front
+// of its own deque and steals from the back of the others' when it runs dry
+//
+//   JobSystem jobs;                       // one worker per core but one
+//   jobs.parallel_for(count, 4096, [&](size_t begin, size_t end) { ... });
+//
+// parallel_for cuts the range into chunks of `grain` items and deals them
+// out in contiguous runs, one run per deque, so neighbouring chunks stay on
+// one core and stealing only moves work when the runs turn out uneven. The
+// calling thread works along until its batch is done, which also makes a
+// JobSystem without workers (single core) a plain loop.
+//
+// The deques are mutex protected, which costs nothing measurable at grains
+// of thousands of items; jobs must not throw. They are rings that keep their
+// capacity, so once warmed up a parallel_for does not touch the heap.
+class JobSystem {
+public:
+  explicit JobSystem(int workers = -1) {
+    if (workers < 0)
+      workers = (int)std::max(1u, std::thread::hardware_concurrency()) - 1;
+    queues = std::vector<Queue>(workers + 1); // the last one belongs to callers
+    for (int i = 0; i < workers; i++)
+      threads.push_back(std::thread(&JobSystem::work, this, i));
+  }
+
+  ~JobSystem() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // threads that run jobs, the caller included
+  int thread_count() const { return (int)queues.size(); }
+
+  // run `function(begin, end)` over [0, count) in chunks of at most `grain`,
+  // returns when all of them are done
+  template <typename Function> void parallel_for(size_t count, size_t grain, const Function &function) {
+    if (count == 0)
+      return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || queues.size() == 1) {
+      function(0, count);
+      return;
+    }
+
+    std::atomic<size_t> pending(chunks);
+    auto run = [](const void *context, size_t begin, size_t end) { (*(const Function *)context)(begin, end); };
+    size_t per_queue = (chunks + queues.size() - 1) / queues.size();
+    queued.fetch_add(chunks); // before the pushes, so it never goes below the deques' total
+    for (size_t q = 0, chunk = 0; q < queues.size() && chunk < chunks; q++) {
+      std::lock_guard<std::mutex> lock(queues[q].mutex);
+      for (size_t i = 0; i < per_queue && chunk < chunks; i++, chunk++) {
+        Job job = {run, &function, chunk * grain, std::min(count, (chunk + 1) * grain), &pending};
+        queues[q].push_back(job);
+      }
+    }
+    {
+      // a worker between checking for work and going to sleep holds this
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+
+    // help until the batch is done; jobs of other batches are fine to run too
+    size_t caller = queues.size() - 1;
+    while (pending.load(std::memory_order_acquire) > 0) {
+      Job job;
+      if (take(caller, job))
+        execute(job);
+      else
+        std::this_thread::yield();
+    }
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::vector<Job> ring; // size is a power of two
+    size_t head = 0, count = 0;
+
+    bool empty() const { return count == 0; }
+
+    void push_back(const Job &job) {
+      if (count == ring.size()) {
+        std::vector<Job> grown(std::max<size_t>(64, ring.size() * 2));
+        for (size_t i = 0; i < count; i++)
+          grown[i] = ring[(head + i) & (ring.size() - 1)];
+        ring.swap(grown);
+        head = 0;
+      }
+      ring[(head + count++) & (ring.size() - 1)] = job;
+    }
+
+    Job pop_front() {
+      Job job = ring[head];
+      head = (head + 1) & (ring.size() - 1);
+      count--;
+      return job;
+    }
+
+    Job pop_back() { return ring[(head + --count) & (ring.size() - 1)]; }
+  };
+
+  std::vector<Queue> queues;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> queued{0}; // jobs in all deques
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  // own deque first, front to back through its run, then steal from the far
+  // end of the others
+  bool take(size_t self, Job &job) {
+    if (queued.load(std::memory_order_relaxed) == 0)
+      return false;
+    {
+      std::lock_guard<std::mutex> lock(queues[self].mutex);
+      if (!queues[self].empty()) {
+        job = queues[self].pop_front();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+      Queue &victim = queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.empty()) {
+        job = victim.pop_back();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void execute(const Job &job) {
+    job.function(job.context, job.begin, job.end);
+    job.pending->fetch_sub(1, std::memory_order_release);
+  }
+
+  void work(int self) {
+    for (;;) {
+      Job job;
+      if (take(self, job)) {
+        execute(job);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+      if (stopping)
+        return;
+    }
+  }
+};
+
+#endif // JOB_SYSTEM_H
@@ -0,0 +1,101 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only view of a whole file mapped into the address space. The pages
+// are faulted in by the kernel on first touch, so decoding straight from
+// `data` never materializes a second heap copy of the file contents.
+class MappedFile {
+public:
+  const unsigned char *data;
+  size_t size;
+
+  MappedFile(const char *path) : data(NULL), size(0) {
+#ifdef _WIN32
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    mapping = NULL;
+    if (file == INVALID_HANDLE_VALUE) {
+      std::cout << "ERROR::MAPPED_FILE::OPEN_FAILED: " << path << std::endl;
+      return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+      std::cout << "ERROR::MAPPED_FILE::EMPTY_FILE: " << path << std::endl;
+      return;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+      std::cout << "ERROR::MAPPED_FILE::MMAP_FAILED: " << path << std::endl;
+      return;
+    }
+    data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data)
+      size = (size_t)file_size.QuadPart;
+#else
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      std::cout << "ERROR::MAPPED_FILE::OPEN_FAILED: " << path << std::endl;
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      std::cout << "ERROR::MAPPED_FILE::EMPTY_FILE: " << path << std::endl;
+      return;
+    }
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      std::cout << "ERROR::MAPPED_FILE::MMAP_FAILED: " << path << std::endl;
+      return;
+    }
+    // decoders and uploads walk the file front to back once
+    madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    data = (const unsigned char *)addr;
+    size = (size_t)st.st_size;
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+#else
+    if (data)
+      munmap((void *)data, size);
+    if (fd >= 0)
+      close(fd);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool is_open() const { return data != NULL; }
+
+private:
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,189 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include "glad/glad.h"
+
+#include "gl_resource.h"
+#include "gpu_memory.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// command line switches of the GPU memory budget
+//
+//   --memory-budget MB   most tracked memory before textures lose mip levels
+//                        (default 0, no budget)
+//   --min-mip-size N     textures are not shrunk below N texels on their
+//                        longer side (default 64)
+struct MemoryBudgetOptions {
+  size_t budget = 0; // bytes
+  int min_size = 64;
+};
+
+inline MemoryBudgetOptions parse_memory_budget_options(int argc, char **argv) {
+  MemoryBudgetOptions options;
+  double megabytes = 0.0;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--memory-budget") == 0)
+      megabytes = atof(argv[++i]);
+    else if (strcmp(argv[i], "--min-mip-size") == 0)
+      options.min_size = atoi(argv[++i]);
+  }
+  if (megabytes < 0.0 || options.min_size < 1) {
+    std::cout << "ERROR::MEMORY_BUDGET::INVALID_OPTIONS: budget " << megabytes << " MB, min mip size "
+              << options.min_size << std::endl;
+    return MemoryBudgetOptions();
+  }
+  options.budget = (size_t)(megabytes * 1024.0 * 1024.0);
+  return options;
+}
+
+// keeps the memory tracked in a GpuMemory under a budget by dropping the top
+// mip level of the largest textures
+//
+//   budget.init(parse_memory_budget_options(argc, argv));
+//   budget.allow_mip_drop(texture1.handle());
+//   ...
+//   if (budget.enforce(gpu_memory()))
+//     rebind texture1.name();
+//
+// Immutable storage can't shrink in place, so a drop allocates the texture
+// again one level shorter, blits every remaining level across and retires
+// the old one into gl_delete_queue(), which deletes it once the frames that
+// sampled it are done. That changes the texture's name: the budget only
+// touches textures whose owner handed in their handle, and puts the new name
+// behind it. Everything else is accounted but left alone. Buffers retired or
+// recycled in gl_delete_queue() don't count, the queue releases them itself.
+// Only GL_TEXTURE_2D with color-renderable formats can be dropped.
+class MemoryBudget {
+public:
+  MemoryBudgetOptions options;
+  long dropped_levels = 0; // mip levels dropped so far
+  size_t freed = 0;        // bytes those levels held
+  bool over = false;       // over budget with nothing left to drop
+
+  void init(const MemoryBudgetOptions &budget_options) { options = budget_options; }
+
+  // a handle whose texture is gone is skipped
+  void allow_mip_drop(GlHandle texture) { textures.push_back(texture); }
+
+  // call outside of rendering, it binds framebuffers; returns true when a
+  // texture was replaced and has to be bound again
+  bool enforce(GpuMemory &memory) {
+    if (options.budget == 0)
+      return false;
+    bool replaced = false;
+    // retired and recycled buffers go by themselves, textures don't pay for them
+    while (memory.total() - gl_delete_queue().reclaimable_bytes() > options.budget) {
+      size_t largest = textures.size();
+      size_t largest_bytes = 0;
+      for (size_t i = 0; i < textures.size(); i++) {
+        const GpuAllocation *allocation = memory.find(GPU_TEXTURE, gl_objects().name(textures[i], GL_OBJECT_TEXTURE));
+        if (allocation && droppable(*allocation) && allocation->bytes > largest_bytes) {
+          largest = i;
+          largest_bytes = allocation->bytes;
+        }
+      }
+      if (largest == textures.size()) {
+        if (!over)
+          std::cout << "ERROR::MEMORY_BUDGET::EXCEEDED: " << GpuMemory::mib(memory.total()) << " MiB tracked, "
+                    << GpuMemory::mib(options.budget) << " MiB budget, nothing left to drop" << std::endl;
+        over = true;
+        return replaced;
+      }
+      if (!drop_level(memory, textures[largest])) {
+        textures.erase(textures.begin() + largest);
+        continue;
+      }
+      replaced = true;
+    }
+    over = false;
+    return replaced;
+  }
+
+  void report(std::ostream &out) const {
+    if (options.budget == 0)
+      return;
+    out << "memory budget " << GpuMemory::mib(options.budget) << " MiB: " << dropped_levels
+        << " mip levels dropped, " << GpuMemory::mib(freed) << " MiB freed" << (over ? ", still over" : "")
+        << std::endl;
+  }
+
+  // call while the context is still current
+  void destroy() {
+    if (framebuffers[0])
+      glDeleteFramebuffers(2, framebuffers);
+    framebuffers[0] = framebuffers[1] = 0;
+  }
+
+private:
+  std::vector<GlHandle> textures;
+  unsigned int framebuffers[2] = {0, 0}; // read, draw
+
+  bool droppable(const GpuAllocation &texture) const {
+    return texture.levels > 1 && texture.depth == 1 && std::max(texture.width, texture.height) / 2 >= options.min_size;
+  }
+
+  bool drop_level(GpuMemory &memory, GlHandle handle) {
+    unsigned int old_texture = gl_objects().name(handle);
+    GpuAllocation old = *memory.find(GPU_TEXTURE, old_texture);
+    int width = std::max(old.width / 2, 1), height = std::max(old.height / 2, 1), levels = old.levels - 1;
+
+    GLint texture_binding, read_binding, draw_binding;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture_binding);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_binding);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_binding);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    if (!framebuffers[0])
+      glGenFramebuffers(2, framebuffers);
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    allocate_texture_storage(GL_TEXTURE_2D, levels, old.internal_format, width, height);
+
+    // level n of the new texture is level n + 1 of the old one
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+    bool complete = true;
+    for (int level = 0, w = width, h = height; level < levels && complete; level++) {
+      glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, old_texture, level + 1);
+      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+      complete = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE &&
+                 glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+      if (complete)
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      w = std::max(w / 2, 1);
+      h = std::max(h / 2, 1);
+    }
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_binding);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_binding);
+    glBindTexture(GL_TEXTURE_2D, texture_binding);
+    if (scissor)
+      glEnable(GL_SCISSOR_TEST);
+
+    if (!complete) {
+      std::cout << "ERROR::MEMORY_BUDGET::UNRENDERABLE_FORMAT: texture " << old_texture << " (0x" << std::hex
+                << old.internal_format << std::dec << ") can't drop mip levels" << std::endl;
+      glDeleteTextures(1, &texture);
+      return false;
+    }
+
+    gl_delete_queue().retire(GL_OBJECT_TEXTURE, old_texture);
+    memory.track_texture(texture, old.internal_format, width, height, 1, levels, old.owner);
+    gl_objects().replace(handle, texture);
+    dropped_levels++;
+    freed += old.bytes - memory.find(GPU_TEXTURE, texture)->bytes;
+    return true;
+  }
+};
+
+#endif // MEMORY_BUDGET_H
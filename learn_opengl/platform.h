@@ -0,0 +1,387 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#ifdef CG_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "capture.h"
+#include "gpu_memory.h"
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// command line switches understood by every demo
+//
+//   --headless      render offscreen through EGL, no display needed
+//   --frames N      stop after N frames (headless default: 60)
+//   --dump out.png  write the last frame to a PNG file
+//   --capture PATH  record every frame, to out.y4m or frames/%05d.png (capture.h)
+//   --stats out.txt write the median and p99 frame time on exit
+struct PlatformOptions {
+  bool headless = false;
+  int frames = 0; // 0 = until the window closes
+  std::string dump_path;
+  std::string capture_path;
+  std::string stats_path;
+};
+
+inline PlatformOptions parse_platform_options(int argc, char **argv) {
+  PlatformOptions options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      options.frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+      options.dump_path = argv[++i];
+    else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+      options.capture_path = argv[++i];
+    else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+      options.stats_path = argv[++i];
+  }
+  if (options.headless && options.frames <= 0)
+    options.frames = 60;
+  return options;
+}
+
+// demo specific switches without a value, e.g. --camera-path
+inline bool has_flag(int argc, char **argv, const char *flag) {
+  for (int i = 1; i < argc; i++)
+    if (strcmp(argv[i], flag) == 0)
+      return true;
+  return false;
+}
+
+// owns the GL context of a demo: a GLFW window, or with --headless an EGL
+// context (Mesa surfaceless platform when available, llvmpipe works) that
+// renders into an offscreen framebuffer object of the window size.
+//
+// Headless runs advance get_time() by exactly 1/60 s per frame, so the same
+// command line always renders the same frames.
+class Platform {
+public:
+  GLFWwindow *window;       // NULL when headless
+  unsigned int framebuffer; // what demos should treat as "the screen"
+  PlatformOptions options;
+  std::atomic<long> frame; // advanced by swap_buffers(), possibly on a render thread
+  FrameCapture capture;    // open when --capture was given, fed by swap_buffers()
+
+  Platform()
+      : window(NULL), framebuffer(0), frame(0), width(0), height(0), color_buffer(0), depth_buffer(0)
+#ifdef CG_HAS_EGL
+        ,
+        display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT)
+#endif
+  {
+  }
+
+  // create the context and load the GL function pointers
+  bool init(int argc, char **argv, int window_width, int window_height, const char *title) {
+    options = parse_platform_options(argc, argv);
+    width = window_width;
+    height = window_height;
+    if (options.headless)
+      return init_headless();
+
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // glfw window creation
+    // --------------------
+    window = glfwCreateWindow(width, height, title, NULL, NULL);
+    if (window == NULL) {
+      std::cout << "Failed to create GLFW window" << std::endl;
+      glfwTerminate();
+      return false;
+    }
+    glfwMakeContextCurrent(window);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      std::cout << "Failed to initialize GLAD" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool headless() const { return window == NULL; }
+
+  bool should_close() {
+    if (options.frames > 0 && frame >= options.frames)
+      return true;
+    return window ? glfwWindowShouldClose(window) : false;
+  }
+
+  // present the frame; the final frame is dumped first when asked to, and
+  // every frame is captured with --capture
+  void swap_buffers() {
+    int w, h;
+    get_framebuffer_size(&w, &h);
+    swap_buffers(w, h);
+  }
+
+  // from a thread other than the main one, which must not query the window:
+  // the framebuffer size of the frame, as the main thread last saw it
+  void swap_buffers(int framebuffer_width, int framebuffer_height) {
+    long presented = ++frame;
+    if (!options.dump_path.empty() && options.frames > 0 && presented == options.frames)
+      dump(options.dump_path.c_str(), framebuffer_width, framebuffer_height);
+    if (!options.capture_path.empty())
+      capture_frame(framebuffer_width, framebuffer_height);
+    if (window)
+      glfwSwapBuffers(window);
+    else if (!options.stats_path.empty())
+      glFinish(); // frame times should include the rendering
+    else
+      glFlush(); // what a swap would do, keeps the GPU a bounded number of frames behind
+    if (!options.stats_path.empty())
+      record_frame_time();
+  }
+
+  void poll_events() {
+    if (window)
+      glfwPollEvents();
+  }
+
+  double get_time() const { return window ? glfwGetTime() : frame / 60.0; }
+
+  // move the context between threads: release it on the thread that has it,
+  // then make it current on the one that takes over
+  void make_current() {
+    if (window)
+      glfwMakeContextCurrent(window);
+#ifdef CG_HAS_EGL
+    else
+      eglMakeCurrent(display, surface, surface, context);
+#endif
+  }
+
+  void release_current() {
+    if (window)
+      glfwMakeContextCurrent(NULL);
+#ifdef CG_HAS_EGL
+    else
+      eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+#endif
+  }
+
+  void get_framebuffer_size(int *w, int *h) const {
+    if (window) {
+      glfwGetFramebufferSize(window, w, h);
+    } else {
+      *w = width;
+      *h = height;
+    }
+  }
+
+  // read back the current frame and write it as PNG
+  bool dump(const char *path) {
+    int w, h;
+    get_framebuffer_size(&w, &h);
+    return dump(path, w, h);
+  }
+
+  bool dump(const char *path, int w, int h) {
+    std::vector<unsigned char> pixels((size_t)w * h * 3);
+    GLint read_framebuffer, pack_alignment;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+    // rows come bottom up; a negative stride writes them top down without
+    // stbi_flip_vertically_on_write, a global the capture encoder would race on
+    int stride = w * 3;
+    if (!stbi_write_png(path, w, h, 3, pixels.data() + (size_t)(h - 1) * stride, -stride)) {
+      std::cout << "ERROR::PLATFORM::DUMP_FAILED: " << path << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void terminate() {
+    if (!options.stats_path.empty())
+      write_stats(options.stats_path.c_str());
+    if (capture.is_open()) {
+      capture.close();
+      std::cout << "captured " << capture.written << " frames to " << capture.path() << ", encoder stalled "
+                << capture.stalls << " times" << std::endl;
+    }
+    if (window) {
+      glfwTerminate();
+      window = NULL;
+      return;
+    }
+#ifdef CG_HAS_EGL
+    if (framebuffer) {
+      gpu_memory().release(GPU_RENDERBUFFER, color_buffer);
+      gpu_memory().release(GPU_RENDERBUFFER, depth_buffer);
+      glDeleteFramebuffers(1, &framebuffer);
+      glDeleteRenderbuffers(1, &color_buffer);
+      glDeleteRenderbuffers(1, &depth_buffer);
+      framebuffer = 0;
+    }
+    if (display != EGL_NO_DISPLAY) {
+      eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+      if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+      eglTerminate(display);
+      display = EGL_NO_DISPLAY;
+    }
+#endif
+  }
+
+private:
+  int width;
+  int height;
+  std::vector<double> frame_times; // ms, only with --stats
+  std::chrono::steady_clock::time_point last_swap;
+  unsigned int color_buffer;
+  unsigned int depth_buffer;
+#ifdef CG_HAS_EGL
+  EGLDisplay display;
+  EGLSurface surface;
+  EGLContext context;
+#endif
+
+  void capture_frame(int w, int h) {
+    if (!capture.is_open() && !capture.open(options.capture_path.c_str(), w, h)) {
+      options.capture_path.clear();
+      return;
+    }
+    GLint read_framebuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    capture.capture(w, h);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+  }
+
+  void record_frame_time() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (frame > 1)
+      frame_times.push_back(std::chrono::duration<double, std::milli>(now - last_swap).count());
+    last_swap = now;
+  }
+
+  // the first frames pay for shader compilation and uploads, leave them out
+  void write_stats(const char *path) {
+    std::vector<double> times(frame_times.begin() + std::min<size_t>(frame_times.size() / 10, 5), frame_times.end());
+    std::sort(times.begin(), times.end());
+    FILE *file = fopen(path, "w");
+    if (!file) {
+      std::cout << "ERROR::PLATFORM::STATS_OPEN_FAILED: " << path << std::endl;
+      return;
+    }
+    double median = times.empty() ? 0.0 : times[times.size() / 2];
+    double p99 = times.empty() ? 0.0 : times[std::min(times.size() - 1, times.size() * 99 / 100)];
+    fprintf(file, "frames %d\nmedian_ms %.4f\np99_ms %.4f\n", (int)times.size(), median, p99);
+    fclose(file);
+  }
+
+  bool init_headless() {
+#ifdef CG_HAS_EGL
+    // prefer Mesa's surfaceless platform, it needs no X/Wayland/DRM device
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display && client_extensions && strstr(client_extensions, "EGL_MESA_platform_surfaceless"))
+      display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      std::cout << "Failed to initialize EGL" << std::endl;
+      return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = NULL;
+    EGLint config_count = 0;
+    eglChooseConfig(display, config_attributes, &config, 1, &config_count);
+
+    EGLint context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                   3,
+                                   EGL_CONTEXT_MINOR_VERSION,
+                                   3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                   EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                   EGL_NONE};
+    context = eglCreateContext(display, config_count ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT) {
+      std::cout << "Failed to create EGL context" << std::endl;
+      return false;
+    }
+
+    // a 1x1 pbuffer only when surfaceless contexts aren't supported, all
+    // rendering goes to the framebuffer object below anyway
+    const char *display_extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!display_extensions || !strstr(display_extensions, "EGL_KHR_surfaceless_context")) {
+      EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+      surface = config_count ? eglCreatePbufferSurface(display, config, pbuffer_attributes) : EGL_NO_SURFACE;
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+      std::cout << "Failed to make the EGL context current" << std::endl;
+      return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+      std::cout << "Failed to initialize GLAD" << std::endl;
+      return false;
+    }
+
+    glGenRenderbuffers(1, &color_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    gpu_memory().track_renderbuffer(color_buffer, GL_RGBA8, width, height, "framebuffer");
+    glGenRenderbuffers(1, &depth_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    gpu_memory().track_renderbuffer(depth_buffer, GL_DEPTH24_STENCIL8, width, height, "framebuffer");
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "ERROR::PLATFORM::FRAMEBUFFER_INCOMPLETE" << std::endl;
+      return false;
+    }
+    glViewport(0, 0, width, height);
+
+    std::cout << "headless: " << glGetString(GL_RENDERER) << ", " << options.frames << " frames" << std::endl;
+    return true;
+#else
+    std::cout << "--headless needs EGL, rebuild with EGL available" << std::endl;
+    return false;
+#endif
+  }
+};
+
+#endif // PLATFORM_H
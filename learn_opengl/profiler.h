@@ -0,0 +1,391 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// frame profiler
+//
+//   PROFILE_BEGIN_FRAME();
+//   { PROFILE_SCOPE("cubes"); ...draw... }
+//   PROFILE_END_FRAME();
+//
+// Every scope records CPU begin/end and a pair of GL_TIMESTAMP queries, the
+// whole frame is also measured with a GL_TIME_ELAPSED query. Query results are
+// read FRAMES_IN_FLIGHT frames later and only when already available, so the
+// profiler never waits on the GPU; late frames are counted as dropped.
+//
+// PROFILE_COUNTER(track, series, value) plots a value over time instead,
+// e.g. memory per owner. Each track is one counter graph in the trace, with
+// one line per series, and report() lists the latest values.
+//
+// The macros expand to nothing unless CG_PROFILE is defined (cmake
+// -DCG_PROFILE=ON), the classes below are only compiled when used.
+
+struct ProfileStats {
+  double min = 0.0; // ms
+  double avg = 0.0;
+  double p99 = 0.0;
+  int samples = 0;
+};
+
+// the last `capacity` samples of one measurement, in ms
+class ProfileWindow {
+public:
+  explicit ProfileWindow(size_t capacity = 120) : samples(capacity, 0.0), next(0), count(0) {}
+
+  void add(double ms) {
+    samples[next] = ms;
+    next = (next + 1) % samples.size();
+    count = std::min(count + 1, samples.size());
+  }
+
+  ProfileStats stats() const {
+    ProfileStats result;
+    if (count == 0)
+      return result;
+    std::vector<double> sorted(samples.begin(), samples.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double ms : sorted)
+      sum += ms;
+    result.min = sorted.front();
+    result.avg = sum / count;
+    result.p99 = sorted[(size_t)std::ceil(0.99 * count) - 1];
+    result.samples = (int)count;
+    return result;
+  }
+
+private:
+  std::vector<double> samples;
+  size_t next;
+  size_t count;
+};
+
+class Profiler {
+public:
+  static const int FRAMES_IN_FLIGHT = 2;
+
+  long frame;
+  long dropped_frames; // GPU results that were not ready in time
+
+  Profiler() : frame(0), dropped_frames(0), frame_open(false), tracing(false), trace_limit(0) {
+    epoch = std::chrono::steady_clock::now();
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+      slots[i].frame_query = 0;
+      slots[i].pending = false;
+    }
+  }
+
+  void begin_frame() {
+    FrameSlot &slot = slots[frame % FRAMES_IN_FLIGHT];
+    if (slot.pending)
+      resolve(slot);
+    if (!slot.frame_query) {
+      glGenQueries(1, &slot.frame_query);
+      calibrate();
+    } else if (frame % 60 == 0) {
+      calibrate(); // GPU and CPU clocks drift apart
+    }
+
+    slot.scopes.clear();
+    slot.cpu_begin = now();
+    slot.frame = frame;
+    glBeginQuery(GL_TIME_ELAPSED, slot.frame_query);
+    frame_open = true;
+  }
+
+  void end_frame() {
+    if (!frame_open)
+      return;
+    FrameSlot &slot = slots[frame % FRAMES_IN_FLIGHT];
+    glEndQuery(GL_TIME_ELAPSED);
+    slot.cpu_end = now();
+    slot.pending = true;
+    frame_open = false;
+    frame++;
+  }
+
+  // returns a handle for end_scope(), -1 outside of a frame
+  int begin_scope(const char *name) {
+    if (!frame_open)
+      return -1;
+    FrameSlot &slot = slots[frame % FRAMES_IN_FLIGHT];
+    size_t index = slot.scopes.size();
+    if (slot.queries.size() < 2 * (index + 1)) {
+      slot.queries.resize(2 * (index + 1));
+      glGenQueries(2, &slot.queries[2 * index]);
+    }
+    Scope scope;
+    scope.name = name;
+    scope.cpu_begin = now();
+    scope.cpu_end = scope.cpu_begin;
+    slot.scopes.push_back(scope);
+    glQueryCounter(slot.queries[2 * index], GL_TIMESTAMP);
+    return (int)index;
+  }
+
+  void end_scope(int index) {
+    if (index < 0 || !frame_open)
+      return;
+    FrameSlot &slot = slots[frame % FRAMES_IN_FLIGHT];
+    glQueryCounter(slot.queries[2 * index + 1], GL_TIMESTAMP);
+    slot.scopes[index].cpu_end = now();
+  }
+
+  // `track` and `series` must outlive the profiler, string literals do
+  void counter(const char *track, const char *series, double value) {
+    counters[track][series] = value;
+    if (tracing && trace.size() + counter_trace.size() < trace_limit)
+      counter_trace.push_back({track, series, now(), value});
+  }
+
+  ProfileStats cpu_stats(const std::string &name) const {
+    auto it = entries.find(name);
+    return it == entries.end() ? ProfileStats() : it->second.cpu.stats();
+  }
+
+  ProfileStats gpu_stats(const std::string &name) const {
+    auto it = entries.find(name);
+    return it == entries.end() ? ProfileStats() : it->second.gpu.stats();
+  }
+
+  // min / avg / p99 of every scope over the rolling window, "frame" included
+  void report(std::ostream &out) const {
+    out << std::fixed << std::setprecision(3);
+    out << "profile (ms)            cpu min/avg/p99            gpu min/avg/p99" << std::endl;
+    for (const auto &entry : entries) {
+      ProfileStats cpu = entry.second.cpu.stats(), gpu = entry.second.gpu.stats();
+      out << "  " << std::left << std::setw(16) << entry.first << std::right << std::setw(8) << cpu.min
+          << std::setw(8) << cpu.avg << std::setw(8) << cpu.p99 << "    " << std::setw(8) << gpu.min
+          << std::setw(8) << gpu.avg << std::setw(8) << gpu.p99 << std::endl;
+    }
+    if (dropped_frames)
+      out << "  " << dropped_frames << " frames without GPU results" << std::endl;
+    for (const auto &track : counters) {
+      out << "  " << track.first << ":";
+      for (const auto &series : track.second)
+        out << " " << series.first << " " << series.second;
+      out << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+  }
+
+  // record scopes of the following frames for write_trace()
+  void start_trace(size_t max_events = 1 << 20) {
+    trace.clear();
+    counter_trace.clear();
+    tracing = true;
+    trace_limit = max_events;
+  }
+
+  // Chrome trace event JSON, open with chrome://tracing or ui.perfetto.dev
+  bool write_trace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+      std::cout << "ERROR::PROFILER::TRACE_OPEN_FAILED: " << path << std::endl;
+      return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+    for (const TraceEvent &event : trace) {
+      fprintf(file, ",\n{\"name\":");
+      write_json_string(file, event.name);
+      fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%ld}}",
+              event.gpu ? 2 : 1, event.begin * 1000.0, (event.end - event.begin) * 1000.0, event.frame);
+    }
+    for (const CounterEvent &event : counter_trace) {
+      fprintf(file, ",\n{\"name\":");
+      write_json_string(file, event.track);
+      fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", event.time * 1000.0);
+      write_json_string(file, event.series);
+      fprintf(file, ":%.6g}}", event.value);
+    }
+    fprintf(file, "\n]}\n");
+    bool ok = fclose(file) == 0;
+    if (ok)
+      std::cout << "wrote " << trace.size() + counter_trace.size() << " trace events to " << path << std::endl;
+    return ok;
+  }
+
+  // release the queries, call while the context is still current
+  void destroy() {
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+      FrameSlot &slot = slots[i];
+      if (slot.frame_query)
+        glDeleteQueries(1, &slot.frame_query);
+      if (!slot.queries.empty())
+        glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+      slot.frame_query = 0;
+      slot.queries.clear();
+      slot.scopes.clear();
+      slot.pending = false;
+    }
+  }
+
+private:
+  struct Scope {
+    const char *name;
+    double cpu_begin; // ms since epoch
+    double cpu_end;
+  };
+
+  struct FrameSlot {
+    std::vector<Scope> scopes;
+    std::vector<GLuint> queries; // begin/end timestamp per scope
+    GLuint frame_query;          // GL_TIME_ELAPSED over the frame
+    bool pending;
+    long frame;
+    double cpu_begin;
+    double cpu_end;
+  };
+
+  struct Entry {
+    ProfileWindow cpu;
+    ProfileWindow gpu;
+  };
+
+  struct TraceEvent {
+    const char *name;
+    double begin; // ms on the CPU timeline
+    double end;
+    long frame;
+    bool gpu;
+  };
+
+  struct CounterEvent {
+    const char *track;
+    const char *series;
+    double time; // ms on the CPU timeline
+    double value;
+  };
+
+  std::chrono::steady_clock::time_point epoch;
+  FrameSlot slots[FRAMES_IN_FLIGHT];
+  bool frame_open;
+
+  std::map<std::string, Entry> entries;
+  std::map<std::string, std::map<std::string, double>> counters; // latest value per track and series
+
+  // GPU timestamp (ns) that corresponds to gpu_reference_cpu (ms)
+  GLint64 gpu_reference;
+  double gpu_reference_cpu;
+
+  bool tracing;
+  size_t trace_limit;
+  std::vector<TraceEvent> trace;
+  std::vector<CounterEvent> counter_trace;
+
+  static void write_json_string(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const char *c = text; *c; c++) {
+      if (*c == '"' || *c == '\\')
+        fputc('\\', file);
+      fputc(*c, file);
+    }
+    fputc('"', file);
+  }
+
+  double now() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count(); }
+
+  void calibrate() {
+    glGetInteger64v(GL_TIMESTAMP, &gpu_reference);
+    gpu_reference_cpu = now();
+  }
+
+  double gpu_to_cpu(GLuint64 timestamp) const {
+    return gpu_reference_cpu + (double)((GLint64)timestamp - gpu_reference) / 1.0e6;
+  }
+
+  void add_trace(const char *name, double begin, double end, long frame_index, bool gpu) {
+    if (tracing && trace.size() < trace_limit)
+      trace.push_back({name, begin, end, frame_index, gpu});
+  }
+
+  void resolve(FrameSlot &slot) {
+    slot.pending = false;
+
+    // the frame query ends last, once it is available every timestamp is
+    GLint available = 0;
+    glGetQueryObjectiv(slot.frame_query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+    entries["frame"].cpu.add(slot.cpu_end - slot.cpu_begin);
+    add_trace("frame", slot.cpu_begin, slot.cpu_end, slot.frame, false);
+    if (available) {
+      GLuint64 elapsed;
+      glGetQueryObjectui64v(slot.frame_query, GL_QUERY_RESULT, &elapsed);
+      // the first frame soaks up driver warm-up, llvmpipe even reports the
+      // elapsed time since context creation for it
+      if (slot.frame > 0)
+        entries["frame"].gpu.add(elapsed / 1.0e6);
+    } else {
+      dropped_frames++;
+    }
+
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+      const Scope &scope = slot.scopes[i];
+      Entry &entry = entries[scope.name];
+      entry.cpu.add(scope.cpu_end - scope.cpu_begin);
+      add_trace(scope.name, scope.cpu_begin, scope.cpu_end, slot.frame, false);
+      if (!available)
+        continue;
+      GLuint64 begin, end;
+      glGetQueryObjectui64v(slot.queries[2 * i], GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(slot.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+      entry.gpu.add((end - begin) / 1.0e6);
+      add_trace(scope.name, gpu_to_cpu(begin), gpu_to_cpu(end), slot.frame, true);
+    }
+  }
+};
+
+// the profiler the PROFILE_* macros talk to
+inline Profiler &profiler() {
+  static Profiler instance;
+  return instance;
+}
+
+class ProfileScope {
+public:
+  explicit ProfileScope(const char *name) : index(profiler().begin_scope(name)) {}
+  ~ProfileScope() { profiler().end_scope(index); }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  int index;
+};
+
+#ifdef CG_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNTER(track, series, value) profiler().counter(track, series, value)
+#define PROFILE_BEGIN_FRAME() profiler().begin_frame()
+#define PROFILE_END_FRAME() profiler().end_frame()
+#define PROFILE_REPORT(out) profiler().report(out)
+#define PROFILE_START_TRACE() profiler().start_trace()
+#define PROFILE_WRITE_TRACE(path) profiler().write_trace(path)
+#define PROFILE_SHUTDOWN() profiler().destroy()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNTER(track, series, value) ((void)0)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#define PROFILE_REPORT(out) ((void)0)
+#define PROFILE_START_TRACE() ((void)0)
+#define PROFILE_WRITE_TRACE(path) ((void)0)
+#define PROFILE_SHUTDOWN() ((void)0)
+#endif
+
+#endif // PROFILER_H
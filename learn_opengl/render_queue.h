@@ -0,0 +1,248 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// deferred draw submission
+//
+// Draws are recorded as small POD commands, sorted by a 64 bit key and then
+// issued by submit(), which only touches GL state that actually changes:
+//
+//   63      60 59         48 47          36 35      24 23              0
+//   +---------+-------------+--------------+----------+----------------+
+//   |  pass   |   program   | texture set  |   VAO    |     depth      |
+//   +---------+-------------+--------------+----------+----------------+
+//
+// Programs, texture sets and VAOs are mapped to dense ids the first time they
+// are seen, so the key orders by state first and front to back within equal
+// state. Lower passes are submitted first.
+//
+// Recording touches no GL, so a queue can be filled on one thread and
+// submitted on the thread that owns the context (see render_thread.h). The
+// frame's view and projection are set on every program submit() switches to,
+// through the "view", "projection" and "model" uniforms of 3.6.shader.vs.
+
+const int RENDER_QUEUE_TEXTURE_UNITS = 4;
+
+struct DrawCommand {
+  uint64_t key;
+  unsigned int program;
+  unsigned int vao;
+  unsigned int textures[RENDER_QUEUE_TEXTURE_UNITS]; // GL_TEXTURE_2D on unit i, 0 = unused
+  unsigned int mode;
+  int first;
+  int count;
+  int model; // index into the frame's model matrices
+};
+
+struct RenderQueueStats {
+  int draws = 0;
+  int program_changes = 0;
+  int texture_changes = 0;
+  int vao_changes = 0;
+
+  int state_changes() const { return program_changes + texture_changes + vao_changes; }
+};
+
+class RenderQueue {
+public:
+  bool sorting = true;
+  float depth_range = 1000.0f; // view space distance mapped onto the 24 depth bits
+
+  RenderQueueStats recorded;  // what code order would have cost
+  RenderQueueStats submitted; // what submit() issued
+
+  // drop last frame's commands; `view` is also used to compute the depth bits
+  void begin_frame(const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix) {
+    view = view_matrix;
+    projection = projection_matrix;
+    commands.clear();
+    models.clear();
+  }
+
+  void draw(int pass, unsigned int program, unsigned int vao, const unsigned int *textures, int texture_count,
+            GLenum mode, int first, int count, const glm::mat4 &model) {
+    DrawCommand command;
+    memset(&command, 0, sizeof(command));
+    command.program = program;
+    command.vao = vao;
+    for (int i = 0; i < texture_count && i < RENDER_QUEUE_TEXTURE_UNITS; i++)
+      command.textures[i] = textures[i];
+    command.mode = mode;
+    command.first = first;
+    command.count = count;
+    command.model = (int)models.size();
+    models.push_back(model);
+
+    float distance = -(view * model[3]).z;
+    uint64_t depth = (uint64_t)(std::min(std::max(distance / depth_range, 0.0f), 1.0f) * 0xffffff);
+    command.key = ((uint64_t)(pass & 0xf) << 60) | ((uint64_t)dense_id(program_ids, program) << 48) |
+                  ((uint64_t)texture_set_id(command.textures) << 36) | ((uint64_t)dense_id(vao_ids, vao) << 24) |
+                  depth;
+    commands.push_back(command);
+  }
+
+  // sort (when enabled) and issue every command of the frame
+  void submit() {
+    order.resize(commands.size());
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = (uint32_t)i;
+    recorded = count_changes();
+    if (sorting)
+      radix_sort();
+
+    submitted = RenderQueueStats();
+    unsigned int program = ~0u, vao = ~0u;
+    unsigned int textures[RENDER_QUEUE_TEXTURE_UNITS];
+    std::fill(textures, textures + RENDER_QUEUE_TEXTURE_UNITS, ~0u);
+    ProgramLocations locations;
+    for (uint32_t index : order) {
+      const DrawCommand &command = commands[index];
+      if (command.program != program) {
+        program = command.program;
+        glUseProgram(program);
+        locations = program_locations(program);
+        glUniformMatrix4fv(locations.view, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(locations.projection, 1, GL_FALSE, glm::value_ptr(projection));
+        submitted.program_changes++;
+      }
+      for (int unit = 0; unit < RENDER_QUEUE_TEXTURE_UNITS; unit++) {
+        if (!command.textures[unit] || command.textures[unit] == textures[unit])
+          continue;
+        textures[unit] = command.textures[unit];
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, textures[unit]);
+        submitted.texture_changes++;
+      }
+      if (command.vao != vao) {
+        vao = command.vao;
+        glBindVertexArray(vao);
+        submitted.vao_changes++;
+      }
+      glUniformMatrix4fv(locations.model, 1, GL_FALSE, glm::value_ptr(models[command.model]));
+      glDrawArrays(command.mode, command.first, command.count);
+      submitted.draws++;
+    }
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  size_t size() const { return commands.size(); }
+
+private:
+  struct ProgramLocations {
+    int model = -1;
+    int view = -1;
+    int projection = -1;
+  };
+
+  glm::mat4 view;
+  glm::mat4 projection;
+  std::vector<DrawCommand> commands;
+  std::vector<glm::mat4> models;
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> scratch;
+
+  std::unordered_map<unsigned int, uint32_t> program_ids;
+  std::unordered_map<unsigned int, uint32_t> vao_ids;
+  std::unordered_map<uint64_t, uint32_t> texture_set_ids;
+  std::unordered_map<unsigned int, ProgramLocations> locations_by_program;
+
+  static uint32_t dense_id(std::unordered_map<unsigned int, uint32_t> &ids, unsigned int handle) {
+    auto it = ids.find(handle);
+    if (it != ids.end())
+      return it->second;
+    uint32_t id = (uint32_t)ids.size() & 0xfff;
+    ids[handle] = id;
+    return id;
+  }
+
+  uint32_t texture_set_id(const unsigned int *textures) {
+    uint64_t hash = 1469598103934665603ull; // FNV-1a over the bound names
+    for (int i = 0; i < RENDER_QUEUE_TEXTURE_UNITS; i++) {
+      hash ^= textures[i];
+      hash *= 1099511628211ull;
+    }
+    auto it = texture_set_ids.find(hash);
+    if (it != texture_set_ids.end())
+      return it->second;
+    uint32_t id = (uint32_t)texture_set_ids.size() & 0xfff;
+    texture_set_ids[hash] = id;
+    return id;
+  }
+
+  ProgramLocations program_locations(unsigned int program) {
+    auto it = locations_by_program.find(program);
+    if (it != locations_by_program.end())
+      return it->second;
+    ProgramLocations locations;
+    locations.model = glGetUniformLocation(program, "model");
+    locations.view = glGetUniformLocation(program, "view");
+    locations.projection = glGetUniformLocation(program, "projection");
+    locations_by_program[program] = locations;
+    return locations;
+  }
+
+  // least significant digit first, 8 bits per pass; digits that are equal
+  // for every key (unused passes, few programs) are skipped
+  void radix_sort() {
+    size_t n = order.size();
+    if (n < 2)
+      return;
+    static const int DIGITS = 8;
+    FrameVector<uint32_t> histograms(DIGITS * 256, 0);
+    for (const DrawCommand &command : commands)
+      for (int digit = 0; digit < DIGITS; digit++)
+        histograms[digit * 256 + ((command.key >> (digit * 8)) & 0xff)]++;
+
+    scratch.resize(n);
+    for (int digit = 0; digit < DIGITS; digit++) {
+      uint32_t *histogram = &histograms[digit * 256];
+      if (histogram[(commands[0].key >> (digit * 8)) & 0xff] == n)
+        continue;
+      uint32_t offset = 0;
+      for (int bucket = 0; bucket < 256; bucket++) {
+        uint32_t count = histogram[bucket];
+        histogram[bucket] = offset;
+        offset += count;
+      }
+      for (uint32_t index : order)
+        scratch[histogram[(commands[index].key >> (digit * 8)) & 0xff]++] = index;
+      order.swap(scratch);
+    }
+  }
+
+  // state transitions of the current order, without touching GL
+  RenderQueueStats count_changes() const {
+    RenderQueueStats stats;
+    unsigned int program = ~0u, vao = ~0u;
+    unsigned int textures[RENDER_QUEUE_TEXTURE_UNITS];
+    std::fill(textures, textures + RENDER_QUEUE_TEXTURE_UNITS, ~0u);
+    for (uint32_t index : order) {
+      const DrawCommand &command = commands[index];
+      stats.program_changes += command.program != program;
+      program = command.program;
+      for (int unit = 0; unit < RENDER_QUEUE_TEXTURE_UNITS; unit++) {
+        if (command.textures[unit] && command.textures[unit] != textures[unit]) {
+          textures[unit] = command.textures[unit];
+          stats.texture_changes++;
+        }
+      }
+      stats.vao_changes += command.vao != vao;
+      vao = command.vao;
+      stats.draws++;
+    }
+    return stats;
+  }
+};
+
+#endif // RENDER_QUEUE_H
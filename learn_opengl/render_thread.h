@@ -0,0 +1,155 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "platform.h"
+#include "profiler.h"
+#include "render_queue.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// milliseconds on the clock used for latency measurements
+inline double render_clock_ms() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// everything the render thread needs to draw one frame, filled in by the
+// main thread without touching GL
+struct RenderFrame {
+  RenderQueue queue;
+  glm::vec4 clear_color = glm::vec4(0.2f, 0.3f, 0.3f, 1.0f);
+  int viewport_width = 0;
+  int viewport_height = 0;
+  double input_time = 0.0; // render_clock_ms() when the input of this frame was sampled
+  long index = 0;
+};
+
+// a thread that owns the GL context and submits the frames the main thread
+// records
+//
+//   main thread                          render thread
+//   poll input, update, record N+1  ||   submit N, swap
+//
+// There are two RenderFrame slots. begin_frame() blocks until the slot of
+// frame N-1 has been presented, so the main thread is never more than one
+// frame ahead: input sampled for a frame reaches the screen at most one frame
+// later than on a single thread. `latency` measures it (input sampled to
+// swap returned).
+//
+// GLFW only allows event polling and window queries on the main thread,
+// which is why the window stays there and only the context moves.
+class RenderThread {
+public:
+  static const int SLOTS = 2;
+
+  RenderThread() : platform(NULL), recording(0), stopping(false), presented(0) {
+    for (int i = 0; i < SLOTS; i++)
+      ready[i] = false;
+  }
+
+  // hand the context over, call after all GL setup on the main thread
+  void start(Platform *owner) {
+    platform = owner;
+    platform->release_current();
+    thread = std::thread(&RenderThread::run, this);
+  }
+
+  // the slot to record the next frame into, waits while it is still queued
+  RenderFrame &begin_frame() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !ready[recording]; });
+    return frames[recording];
+  }
+
+  // publish the frame returned by begin_frame()
+  void end_frame() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ready[recording] = true;
+      recording = (recording + 1) % SLOTS;
+    }
+    condition.notify_all();
+  }
+
+  // finish the queued frames and take the context back to the calling thread
+  void stop() {
+    if (!thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+    platform->make_current();
+  }
+
+  long frames_presented() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return presented;
+  }
+
+  ProfileStats latency_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latency.stats();
+  }
+
+private:
+  Platform *platform;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable condition;
+
+  RenderFrame frames[SLOTS];
+  bool ready[SLOTS];
+  int recording; // slot the main thread fills next
+  bool stopping;
+
+  long presented;
+  ProfileWindow latency;
+
+  void run() {
+    platform->make_current();
+    int rendering = 0;
+    int viewport_width = 0, viewport_height = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return ready[rendering] || stopping; });
+        if (!ready[rendering])
+          break;
+      }
+
+      // the slot is ours until it is marked free below
+      RenderFrame &frame = frames[rendering];
+      if (frame.viewport_width != viewport_width || frame.viewport_height != viewport_height) {
+        viewport_width = frame.viewport_width;
+        viewport_height = frame.viewport_height;
+        glViewport(0, 0, viewport_width, viewport_height);
+      }
+      glClearColor(frame.clear_color.x, frame.clear_color.y, frame.clear_color.z, frame.clear_color.w);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      frame.queue.submit();
+      // the window belongs to the main thread, so the size comes with the frame
+      platform->swap_buffers(frame.viewport_width, frame.viewport_height);
+      double shown = render_clock_ms();
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        latency.add(shown - frame.input_time);
+        presented++;
+        ready[rendering] = false;
+      }
+      condition.notify_all();
+      rendering = (rendering + 1) % SLOTS;
+    }
+    platform->release_current();
+  }
+};
+
+#endif // RENDER_THREAD_H
@@ -0,0 +1,104 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "glad/glad.h"
+
+#include "gl_extensions.h"
+
+#include <map>
+#include <tuple>
+
+// filtering and addressing state, kept out of the texture objects so the same
+// texture can be sampled differently and filtering can change globally
+struct SamplerDesc {
+  GLenum min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  GLenum mag_filter = GL_LINEAR;
+  GLenum wrap_s = GL_REPEAT;
+  GLenum wrap_t = GL_REPEAT;
+  GLenum wrap_r = GL_REPEAT;
+
+  bool operator<(const SamplerDesc &o) const {
+    return std::tie(min_filter, mag_filter, wrap_s, wrap_t, wrap_r) <
+           std::tie(o.min_filter, o.mag_filter, o.wrap_s, o.wrap_t, o.wrap_r);
+  }
+};
+
+// one sampler object per distinct SamplerDesc, shared by every texture unit
+// that asks for it
+class SamplerCache {
+public:
+  static const unsigned int MAX_UNITS = 32;
+
+  SamplerCache() : max_anisotropy(1.0f), anisotropy_supported(-1) {
+    for (unsigned int i = 0; i < MAX_UNITS; i++)
+      bound[i] = 0;
+  }
+
+  unsigned int get(const SamplerDesc &desc) {
+    auto it = samplers.find(desc);
+    if (it != samplers.end())
+      return it->second;
+
+    unsigned int sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.min_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.mag_filter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrap_s);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrap_t);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, desc.wrap_r);
+    apply_anisotropy(sampler, desc);
+    samplers[desc] = sampler;
+    return sampler;
+  }
+
+  // bind the sampler for `desc` to texture unit `unit` (0 based), skipping
+  // the call when the unit already uses it
+  void bind(unsigned int unit, const SamplerDesc &desc) {
+    unsigned int sampler = get(desc);
+    if (unit < MAX_UNITS && bound[unit] == sampler)
+      return;
+    glBindSampler(unit, sampler);
+    if (unit < MAX_UNITS)
+      bound[unit] = sampler;
+  }
+
+  // global filtering quality knob, applied to every mipmapped sampler. No-op
+  // when the context has neither GL 4.6 nor EXT_texture_filter_anisotropic.
+  void set_max_anisotropy(float value) {
+    if (anisotropy_supported < 0)
+      anisotropy_supported = GLAD_GL_VERSION_4_6 || has_gl_extension("GL_EXT_texture_filter_anisotropic") ||
+                             has_gl_extension("GL_ARB_texture_filter_anisotropic");
+    if (!anisotropy_supported)
+      return;
+
+    float limit = 1.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &limit);
+    max_anisotropy = value < 1.0f ? 1.0f : (value > limit ? limit : value);
+    for (auto &entry : samplers)
+      apply_anisotropy(entry.second, entry.first);
+  }
+
+  // needs the GL context, so call it before glfwTerminate
+  void destroy() {
+    for (auto &entry : samplers)
+      glDeleteSamplers(1, &entry.second);
+    samplers.clear();
+    for (unsigned int i = 0; i < MAX_UNITS; i++)
+      bound[i] = 0;
+  }
+
+private:
+  std::map<SamplerDesc, unsigned int> samplers;
+  unsigned int bound[MAX_UNITS];
+  float max_anisotropy;
+  int anisotropy_supported;
+
+  void apply_anisotropy(unsigned int sampler, const SamplerDesc &desc) {
+    if (anisotropy_supported <= 0)
+      return;
+    bool mipmapped = desc.min_filter != GL_NEAREST && desc.min_filter != GL_LINEAR;
+    glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY, mipmapped ? max_anisotropy : 1.0f);
+  }
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aPositionScale; // per instance, xyz position, w uniform scale
+layout (location = 3) in vec4 aRotation;      // per instance, unit quaternion xyzw from snorm16
+
+out vec2 TexCoord;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// q * v * conjugate(q)
+vec3 rotate(vec4 q, vec3 v)
+{
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+  vec4 q = normalize(aRotation); // undo the quantization's change of length
+  vec3 world = aPositionScale.xyz + rotate(q, aPos * aPositionScale.w);
+  gl_Position = projection * view * vec4(world, 1.0);
+  TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel; // per instance, occupies locations 2-5
+
+out vec2 TexCoord;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+  TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+}
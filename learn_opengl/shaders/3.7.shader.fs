@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// every material lives in one array texture, either as a whole layer or as a
+// sub rectangle of an atlas page
+uniform sampler2DArray textures;
+uniform float layer;
+uniform vec4 uv_rect;
+
+void main() {
+  FragColor = texture(textures, vec3(uv_rect.xy + TexCoord * uv_rect.zw, layer));
+}
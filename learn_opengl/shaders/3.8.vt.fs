@@ -0,0 +1,40 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// texture1 of 3.6.shader.fs, now a virtual texture: pages live in the
+// physical cache and page_table maps (page, level) to a cache slot
+uniform sampler2D cache;
+uniform usampler2DArray page_table;
+uniform sampler2D texture2;
+
+uniform vec2 virtual_size; // level 0 size in texels
+uniform float tile_size;
+uniform float border;
+uniform float max_level;
+
+vec4 sample_virtual(vec2 uv) {
+  uv = clamp(uv, vec2(0.0), vec2(0.99999));
+
+  vec2 texel = uv * virtual_size;
+  vec2 dx = dFdx(texel), dy = dFdy(texel);
+  float lod = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0, max_level);
+
+  vec2 level_size = max(floor(virtual_size / exp2(lod)), vec2(1.0));
+  ivec2 page = ivec2(uv * level_size / tile_size);
+  uvec4 entry = texelFetch(page_table, ivec3(page, int(lod)), 0);
+
+  // the entry may point at a coarser resident ancestor
+  level_size = max(floor(virtual_size / exp2(float(entry.b))), vec2(1.0));
+  vec2 page_uv = uv * level_size / tile_size;
+  vec2 in_page = page_uv - floor(page_uv);
+
+  float slot_size = tile_size + 2.0 * border;
+  vec2 cache_texel = vec2(entry.rg) * slot_size + border + in_page * tile_size;
+  return texture(cache, cache_texel / vec2(textureSize(cache, 0)));
+}
+
+void main() {
+  FragColor = mix(sample_virtual(TexCoord), texture(texture2, TexCoord), 0.2);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+out uvec4 Request;
+
+in vec2 TexCoord;
+
+uniform vec2 virtual_size; // level 0 size in texels
+uniform float tile_size;
+uniform float max_level;
+// log2(main resolution / feedback resolution), the feedback target is smaller
+// so its derivatives overestimate the level
+uniform float lod_bias;
+
+void main() {
+  vec2 uv = clamp(TexCoord, vec2(0.0), vec2(0.99999));
+
+  vec2 texel = uv * virtual_size;
+  vec2 dx = dFdx(texel), dy = dFdy(texel);
+  float lod = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - lod_bias), 0.0, max_level);
+
+  vec2 level_size = max(floor(virtual_size / exp2(lod)), vec2(1.0));
+  uvec2 page = uvec2(uv * level_size / tile_size);
+  Request = uvec4(page, uint(lod), 1u);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// the low resolution frame fills uv_scale of the source texture
+uniform sampler2D source;
+uniform vec2 uv_scale;
+uniform vec2 texel;
+uniform float sharpness; // 0 = plain bilinear, 1 = strongest
+
+vec3 fetch(vec2 uv) {
+  return texture(source, clamp(uv, 0.5 * texel, uv_scale - 0.5 * texel)).rgb;
+}
+
+// contrast adaptive sharpening on top of the bilinear sample: the cross of
+// neighbours is subtracted, less where the neighbourhood already has contrast,
+// so edges get crisper without ringing and flat areas stay flat
+void main() {
+  vec2 uv = TexCoord * uv_scale;
+  vec3 center = fetch(uv);
+  if (sharpness <= 0.0) {
+    FragColor = vec4(center, 1.0);
+    return;
+  }
+
+  vec3 north = fetch(uv + vec2(0.0, texel.y));
+  vec3 south = fetch(uv - vec2(0.0, texel.y));
+  vec3 east = fetch(uv + vec2(texel.x, 0.0));
+  vec3 west = fetch(uv - vec2(texel.x, 0.0));
+
+  vec3 lowest = min(center, min(min(north, south), min(east, west)));
+  vec3 highest = max(center, max(max(north, south), max(east, west)));
+  vec3 amount = sqrt(clamp(min(lowest, 1.0 - highest) / max(highest, vec3(1.0e-4)), 0.0, 1.0));
+  vec3 weight = -amount * mix(0.125, 0.2, sharpness);
+
+  vec3 color = (center + weight * (north + south + east + west)) / (1.0 + 4.0 * weight);
+  FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
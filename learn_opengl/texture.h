@@ -0,0 +1,353 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "glad/glad.h"
+
+#include "gpu_memory.h"
+#include "mapped_file.h"
+#include "stb_image.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// number of levels in a full mip chain down to 1x1
+inline int texture_levels(int width, int height) {
+  int levels = 1;
+  for (int size = width > height ? width : height; size > 1; size /= 2)
+    levels++;
+  return levels;
+}
+
+// allocate immutable storage for the texture bound to `target` (GL_TEXTURE_2D
+// or GL_TEXTURE_2D_ARRAY with `depth` layers). Contexts without
+// glTexStorage* (GL < 4.2) get every level specified up front and the mip
+// range clamped, which the driver can validate just as cheaply on bind.
+inline void allocate_texture_storage(GLenum target, int levels, GLenum internal_format, int width, int height,
+                                     int depth = 1) {
+  if (target == GL_TEXTURE_2D_ARRAY ? glTexStorage3D != NULL : glTexStorage2D != NULL) {
+    if (target == GL_TEXTURE_2D_ARRAY)
+      glTexStorage3D(target, levels, internal_format, width, height, depth);
+    else
+      glTexStorage2D(target, levels, internal_format, width, height);
+    return;
+  }
+
+  // any format/type pair matching the internal format is fine with no data,
+  // as long as no unpack buffer turns NULL into an offset
+  GLint unpack_buffer;
+  glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack_buffer);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  GLenum format = internal_format == GL_R8 ? GL_RED : internal_format == GL_RG8 ? GL_RG : GL_RGBA;
+  for (int level = 0; level < levels; level++) {
+    if (target == GL_TEXTURE_2D_ARRAY)
+      glTexImage3D(target, level, internal_format, width, height, depth, 0, format, GL_UNSIGNED_BYTE, NULL);
+    else
+      glTexImage2D(target, level, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer);
+}
+
+// decode an image file into a new texture with immutable storage and a full
+// mip chain. The file is mapped rather than read through stdio, so the only
+// heap allocation is the decoded pixel buffer stb_image hands back.
+//
+// Filtering and wrapping are left at the texture defaults on purpose, bind a
+// sampler object from SamplerCache (sampler.h) to choose them. The storage is
+// recorded in gpu_memory() under `owner`.
+// ------------------------------------------------------------------------
+inline unsigned int load_texture(const char *texture_file, GLenum format, bool flip, const char *owner = "textures") {
+  int width, height, nrChannels;
+
+  // the flag is global state inside stb_image, always set it explicitly
+  stbi_set_flip_vertically_on_load(flip);
+
+  unsigned char *data = NULL;
+  MappedFile file(texture_file);
+  if (file.is_open()) {
+    data = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &nrChannels, 0);
+  }
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  if (data) {
+    GLenum internal_format = format == GL_RED    ? GL_R8
+                             : format == GL_RG   ? GL_RG8
+                             : format == GL_RGBA ? GL_RGBA8
+                                                 : GL_RGB8;
+    allocate_texture_storage(GL_TEXTURE_2D, texture_levels(width, height), internal_format, width, height);
+    gpu_memory().track_texture(texture, internal_format, width, height, 1, texture_levels(width, height), owner);
+
+    GLint unpack_alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+  } else {
+    std::cout << "Failed to load texture" << std::endl;
+  }
+  stbi_image_free(data);
+  return texture;
+}
+
+// decoded pixels kept on the CPU, e.g. for packing several images into one
+// texture before upload
+// ------------------------------------------------------------------------
+struct Image {
+  int width;
+  int height;
+  int channels;
+  std::vector<unsigned char> pixels;
+};
+
+// decode `texture_file` from its mapped pages, forcing `channels` components
+// per pixel when non zero. Returns false if the file can't be decoded.
+inline bool load_image(const char *texture_file, bool flip, int channels, Image &image) {
+  stbi_set_flip_vertically_on_load(flip);
+
+  MappedFile file(texture_file);
+  if (!file.is_open())
+    return false;
+
+  int nrChannels;
+  unsigned char *data = stbi_load_from_memory(file.data, (int)file.size, &image.width, &image.height, &nrChannels,
+                                              channels);
+  if (!data) {
+    std::cout << "Failed to load texture" << std::endl;
+    return false;
+  }
+  image.channels = channels ? channels : nrChannels;
+  image.pixels.assign(data, data + (size_t)image.width * image.height * image.channels);
+  stbi_image_free(data);
+  return true;
+}
+
+// raw baked texture container (.cgtex)
+//
+//   RawTextureHeader
+//   RawTextureLevel[levels]   mip 0 first
+//   pixel data                tightly packed rows (unpack alignment 1)
+//
+// Everything is little endian. Level data is contiguous so the whole payload
+// can be streamed into a single pixel unpack buffer.
+// ------------------------------------------------------------------------
+static const char RAW_TEXTURE_MAGIC[4] = {'C', 'G', 'T', 'X'};
+static const uint32_t RAW_TEXTURE_VERSION = 1;
+
+struct RawTextureHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;          // GL_RED / GL_RG / GL_RGB / GL_RGBA
+  uint32_t internal_format; // sized internal format, e.g. GL_RGBA8
+  uint32_t levels;
+  uint32_t reserved;
+};
+
+struct RawTextureLevel {
+  uint64_t offset; // from the beginning of the file
+  uint64_t size;
+};
+
+inline GLenum raw_texture_format(int channels) {
+  switch (channels) {
+  case 1:
+    return GL_RED;
+  case 2:
+    return GL_RG;
+  case 3:
+    return GL_RGB;
+  default:
+    return GL_RGBA;
+  }
+}
+
+inline GLenum raw_texture_internal_format(int channels) {
+  switch (channels) {
+  case 1:
+    return GL_R8;
+  case 2:
+    return GL_RG8;
+  case 3:
+    return GL_RGB8;
+  default:
+    return GL_RGBA8;
+  }
+}
+
+// 2x2 box filter down to the next mip level, odd edges are clamped
+inline Image downsample_image(const Image &src) {
+  int w = src.width, h = src.height, channels = src.channels;
+  Image dst;
+  dst.width = w > 1 ? w / 2 : 1;
+  dst.height = h > 1 ? h / 2 : 1;
+  dst.channels = channels;
+  dst.pixels.resize((size_t)dst.width * dst.height * channels);
+  for (int y = 0; y < dst.height; y++) {
+    int y0 = y * 2 < h ? y * 2 : h - 1, y1 = y * 2 + 1 < h ? y * 2 + 1 : h - 1;
+    for (int x = 0; x < dst.width; x++) {
+      int x0 = x * 2 < w ? x * 2 : w - 1, x1 = x * 2 + 1 < w ? x * 2 + 1 : w - 1;
+      for (int c = 0; c < channels; c++) {
+        unsigned sum = src.pixels[((size_t)y0 * w + x0) * channels + c] +
+                       src.pixels[((size_t)y0 * w + x1) * channels + c] +
+                       src.pixels[((size_t)y1 * w + x0) * channels + c] +
+                       src.pixels[((size_t)y1 * w + x1) * channels + c];
+        dst.pixels[((size_t)y * dst.width + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+// bake `pixels` (as returned by stbi_load) plus a box filtered mip chain into
+// a .cgtex file, returns false on I/O failure.
+inline bool write_raw_texture(const char *path, const unsigned char *pixels, int width, int height, int channels) {
+  std::vector<Image> mips(1);
+  mips[0].width = width;
+  mips[0].height = height;
+  mips[0].channels = channels;
+  mips[0].pixels.assign(pixels, pixels + (size_t)width * height * channels);
+  while (mips.back().width > 1 || mips.back().height > 1)
+    mips.push_back(downsample_image(mips.back()));
+
+  std::vector<std::vector<unsigned char>> levels;
+  for (Image &mip : mips)
+    levels.push_back(std::move(mip.pixels));
+
+  RawTextureHeader header;
+  memcpy(header.magic, RAW_TEXTURE_MAGIC, 4);
+  header.version = RAW_TEXTURE_VERSION;
+  header.width = (uint32_t)width;
+  header.height = (uint32_t)height;
+  header.format = raw_texture_format(channels);
+  header.internal_format = raw_texture_internal_format(channels);
+  header.levels = (uint32_t)levels.size();
+  header.reserved = 0;
+
+  std::vector<RawTextureLevel> table(levels.size());
+  uint64_t offset = sizeof(RawTextureHeader) + sizeof(RawTextureLevel) * levels.size();
+  for (size_t i = 0; i < levels.size(); i++) {
+    table[i].offset = offset;
+    table[i].size = levels[i].size();
+    offset += levels[i].size();
+  }
+
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    std::cout << "ERROR::RAW_TEXTURE::OPEN_FAILED: " << path << std::endl;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(table.data(), sizeof(RawTextureLevel), table.size(), out) == table.size();
+  for (size_t i = 0; ok && i < levels.size(); i++)
+    ok = fwrite(levels[i].data(), 1, levels[i].size(), out) == levels[i].size();
+  ok = fclose(out) == 0 && ok;
+  if (!ok)
+    std::cout << "ERROR::RAW_TEXTURE::WRITE_FAILED: " << path << std::endl;
+  return ok;
+}
+
+// upload a baked .cgtex texture. The mapped file pages are copied exactly once,
+// straight into a pixel unpack buffer, and every mip level is then specified
+// from offsets into that buffer so the driver can finish the transfer
+// asynchronously. Returns 0 if the file is missing or malformed.
+inline unsigned int load_raw_texture(const char *texture_file, const char *owner = "textures") {
+  MappedFile file(texture_file);
+  if (!file.is_open())
+    return 0;
+
+  if (file.size < sizeof(RawTextureHeader)) {
+    std::cout << "ERROR::RAW_TEXTURE::TRUNCATED: " << texture_file << std::endl;
+    return 0;
+  }
+  RawTextureHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if (memcmp(header.magic, RAW_TEXTURE_MAGIC, 4) != 0 || header.version != RAW_TEXTURE_VERSION ||
+      header.levels == 0 || header.width == 0 || header.height == 0) {
+    std::cout << "ERROR::RAW_TEXTURE::BAD_HEADER: " << texture_file << std::endl;
+    return 0;
+  }
+  size_t table_end = sizeof(RawTextureHeader) + sizeof(RawTextureLevel) * (size_t)header.levels;
+  if (file.size < table_end) {
+    std::cout << "ERROR::RAW_TEXTURE::TRUNCATED: " << texture_file << std::endl;
+    return 0;
+  }
+  std::vector<RawTextureLevel> table(header.levels);
+  memcpy(table.data(), file.data + sizeof(RawTextureHeader), sizeof(RawTextureLevel) * table.size());
+
+  uint64_t channels = header.format == GL_RED ? 1 : header.format == GL_RG ? 2 : header.format == GL_RGB ? 3 : 4;
+  uint64_t payload_begin = table[0].offset;
+  uint64_t payload_end = payload_begin;
+  uint64_t lw = header.width, lh = header.height;
+  for (const RawTextureLevel &level : table) {
+    if (level.offset < table_end || level.offset + level.size > file.size || level.size < lw * lh * channels) {
+      std::cout << "ERROR::RAW_TEXTURE::TRUNCATED: " << texture_file << std::endl;
+      return 0;
+    }
+    lw = lw > 1 ? lw / 2 : 1;
+    lh = lh > 1 ? lh / 2 : 1;
+    if (level.offset < payload_begin)
+      payload_begin = level.offset;
+    if (level.offset + level.size > payload_end)
+      payload_end = level.offset + level.size;
+  }
+
+  unsigned int pbo;
+  glGenBuffers(1, &pbo);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)(payload_end - payload_begin), NULL, GL_STREAM_DRAW);
+  void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)(payload_end - payload_begin),
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (dst) {
+    memcpy(dst, file.data + payload_begin, (size_t)(payload_end - payload_begin));
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  GLint unpack_alignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  allocate_texture_storage(GL_TEXTURE_2D, (int)header.levels, header.internal_format, (int)header.width,
+                           (int)header.height);
+  gpu_memory().track_texture(texture, header.internal_format, (int)header.width, (int)header.height, 1,
+                             (int)header.levels, owner);
+
+  GLsizei w = (GLsizei)header.width, h = (GLsizei)header.height;
+  for (GLint level = 0; level < (GLint)header.levels; level++) {
+    if (dst) {
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, header.format, GL_UNSIGNED_BYTE,
+                      (void *)(uintptr_t)(table[level].offset - payload_begin));
+    } else {
+      // mapping the unpack buffer failed, let the driver copy from the file pages instead
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, header.format, GL_UNSIGNED_BYTE,
+                      file.data + table[level].offset);
+    }
+    w = w > 1 ? w / 2 : 1;
+    h = h > 1 ? h / 2 : 1;
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  // the driver keeps the buffer alive until the pending uploads retire
+  glDeleteBuffers(1, &pbo);
+  return texture;
+}
+
+#endif // TEXTURE_H
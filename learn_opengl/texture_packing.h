@@ -0,0 +1,298 @@
+#ifndef TEXTURE_PACKING_H
+#define TEXTURE_PACKING_H
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+#include "texture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// skyline bottom-left rectangle packer, the skyline is the list of top edges
+// of everything placed so far, sorted by x.
+class SkylinePacker {
+public:
+  int width;
+  int height;
+
+  SkylinePacker(int width, int height) : width(width), height(height) { reset(); }
+
+  void reset() {
+    skyline.clear();
+    skyline.push_back({0, 0, width});
+  }
+
+  // find room for a w x h rectangle, lowest top edge first then leftmost
+  bool pack(int w, int h, int &x, int &y) {
+    int best_index = -1, best_top = height, best_width = width + 1;
+    for (size_t i = 0; i < skyline.size(); i++) {
+      int top;
+      if (!fits(i, w, h, top))
+        continue;
+      if (top < best_top || (top == best_top && skyline[i].width < best_width)) {
+        best_index = (int)i;
+        best_top = top;
+        best_width = skyline[i].width;
+      }
+    }
+    if (best_index < 0)
+      return false;
+
+    x = skyline[best_index].x;
+    y = best_top;
+    insert(best_index, x, y + h, w);
+    return true;
+  }
+
+private:
+  struct Node {
+    int x;
+    int y;
+    int width;
+  };
+  std::vector<Node> skyline;
+
+  // a rectangle starting at node i rests on the highest node it spans
+  bool fits(size_t i, int w, int h, int &top) const {
+    int x = skyline[i].x;
+    if (x + w > width)
+      return false;
+    int remaining = w;
+    top = skyline[i].y;
+    while (remaining > 0) {
+      if (i >= skyline.size())
+        return false;
+      top = std::max(top, skyline[i].y);
+      if (top + h > height)
+        return false;
+      remaining -= skyline[i].width;
+      i++;
+    }
+    return true;
+  }
+
+  void insert(int index, int x, int y, int w) {
+    skyline.insert(skyline.begin() + index, {x, y, w});
+
+    // trim or drop the nodes now covered by the new one
+    for (size_t i = index + 1; i < skyline.size();) {
+      Node &prev = skyline[i - 1];
+      Node &node = skyline[i];
+      int shrink = prev.x + prev.width - node.x;
+      if (shrink <= 0)
+        break;
+      node.x += shrink;
+      node.width -= shrink;
+      if (node.width > 0)
+        break;
+      skyline.erase(skyline.begin() + i);
+    }
+
+    // merge neighbours sitting at the same height
+    for (size_t i = 0; i + 1 < skyline.size();) {
+      if (skyline[i].y == skyline[i + 1].y) {
+        skyline[i].width += skyline[i + 1].width;
+        skyline.erase(skyline.begin() + i + 1);
+      } else {
+        i++;
+      }
+    }
+  }
+};
+
+// where a packed image ended up. Sample it with
+//   texture(sampler2DArray, vec3(uv_rect.xy + uv * uv_rect.zw, layer))
+struct PackedTexture {
+  unsigned int texture; // GL_TEXTURE_2D_ARRAY
+  int layer;
+  glm::vec4 uv_rect; // offset in xy, scale in zw
+};
+
+// collapses many material textures into a handful of GL_TEXTURE_2D_ARRAYs so
+// draws using different materials don't need to rebind anything:
+//
+// - images smaller than `atlas_threshold` in both dimensions are packed into
+//   atlas pages of `atlas_size` squared, one layer per page
+// - larger images sharing size and channel count become layers of one array
+//
+// Usage: add() every image, build() once, then look handles up with get().
+// Sample with a GL_CLAMP_TO_EDGE sampler, atlas entries can't wrap. Atlas
+// pages only get the mip levels their gutter keeps apart, 2 with the default
+// padding; layered images get the full chain.
+class TexturePacker {
+public:
+  std::vector<unsigned int> textures; // every array texture created by build()
+
+  TexturePacker(int atlas_size = 2048, int atlas_threshold = 256, int padding = 2)
+      : atlas_size(atlas_size), atlas_threshold(atlas_threshold), padding(padding) {}
+
+  // needs the GL context, so call it before glfwTerminate
+  void destroy() {
+    for (unsigned int texture : textures)
+      gpu_memory().release(GPU_TEXTURE, texture);
+    if (!textures.empty())
+      glDeleteTextures((GLsizei)textures.size(), textures.data());
+    textures.clear();
+  }
+
+  TexturePacker(const TexturePacker &) = delete;
+  TexturePacker &operator=(const TexturePacker &) = delete;
+
+  // returns the handle to pass to get() once build() has run
+  int add(const Image &image) {
+    images.push_back(image);
+    packed.push_back({0, 0, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)});
+    return (int)images.size() - 1;
+  }
+
+  // -1 when the file can't be loaded, get() resolves that to no texture
+  int add(const char *texture_file, bool flip, int channels = 4) {
+    Image image;
+    if (!load_image(texture_file, flip, channels, image)) {
+      std::cout << "ERROR::TEXTURE_PACKER::LOAD_FAILED: " << texture_file << std::endl;
+      return -1;
+    }
+    return add(image);
+  }
+
+  // an unknown handle gets texture 0, which samples as black
+  const PackedTexture &get(int handle) const {
+    static const PackedTexture missing = {0, 0, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)};
+    if (handle < 0 || handle >= (int)packed.size())
+      return missing;
+    return packed[handle];
+  }
+
+  void build() {
+    // key: width, height, channels. Atlas pages use the atlas size
+    std::map<std::tuple<int, int, int>, std::vector<int>> layered;
+    std::map<int, std::vector<int>> atlased;
+    for (size_t i = 0; i < images.size(); i++) {
+      const Image &image = images[i];
+      if (image.width + 2 * padding <= atlas_size && image.height + 2 * padding <= atlas_size &&
+          image.width < atlas_threshold && image.height < atlas_threshold)
+        atlased[image.channels].push_back((int)i);
+      else
+        layered[std::make_tuple(image.width, image.height, image.channels)].push_back((int)i);
+    }
+
+    for (auto &group : layered)
+      build_layers(std::get<0>(group.first), std::get<1>(group.first), std::get<2>(group.first), group.second);
+    for (auto &group : atlased)
+      build_atlas(group.first, group.second);
+
+    // pixels live on the GPU from now on
+    images.clear();
+    images.shrink_to_fit();
+  }
+
+private:
+  int atlas_size;
+  int atlas_threshold;
+  int padding;
+  std::vector<Image> images;
+  std::vector<PackedTexture> packed;
+
+  unsigned int create_array(int width, int height, int layers, int channels, int levels) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    allocate_texture_storage(GL_TEXTURE_2D_ARRAY, levels, raw_texture_internal_format(channels), width, height, layers);
+    gpu_memory().track_texture(texture, raw_texture_internal_format(channels), width, height, layers, levels,
+                               "texture arrays");
+    textures.push_back(texture);
+    return texture;
+  }
+
+  void build_layers(int width, int height, int channels, const std::vector<int> &members) {
+    unsigned int texture = create_array(width, height, (int)members.size(), channels, texture_levels(width, height));
+
+    GLint unpack_alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t layer = 0; layer < members.size(); layer++) {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer, width, height, 1, raw_texture_format(channels),
+                      GL_UNSIGNED_BYTE, images[members[layer]].pixels.data());
+      packed[members[layer]] = {texture, (int)layer, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)};
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  }
+
+  void build_atlas(int channels, std::vector<int> members) {
+    // tallest first keeps the skyline flat
+    std::sort(members.begin(), members.end(), [this](int a, int b) {
+      return images[a].height != images[b].height ? images[a].height > images[b].height
+                                                  : images[a].width > images[b].width;
+    });
+
+    struct Placement {
+      int image;
+      int page;
+      int x;
+      int y;
+    };
+    std::vector<Placement> placements;
+    std::vector<SkylinePacker> pages;
+    for (int member : members) {
+      int w = images[member].width + 2 * padding, h = images[member].height + 2 * padding;
+      int x = 0, y = 0;
+      size_t page = 0;
+      while (page < pages.size() && !pages[page].pack(w, h, x, y))
+        page++;
+      if (page == pages.size()) {
+        pages.emplace_back(atlas_size, atlas_size);
+        pages.back().pack(w, h, x, y);
+      }
+      placements.push_back({member, (int)page, x + padding, y + padding});
+    }
+
+    unsigned int texture = create_array(atlas_size, atlas_size, (int)pages.size(), channels, atlas_levels());
+
+    GLint unpack_alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const Placement &p : placements) {
+      std::vector<unsigned char> padded = pad(images[p.image]);
+      const Image &image = images[p.image];
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, p.x - padding, p.y - padding, p.page, image.width + 2 * padding,
+                      image.height + 2 * padding, 1, raw_texture_format(channels), GL_UNSIGNED_BYTE, padded.data());
+      packed[p.image] = {texture, p.page,
+                         glm::vec4((float)p.x / atlas_size, (float)p.y / atlas_size, (float)image.width / atlas_size,
+                                   (float)image.height / atlas_size)};
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  }
+
+  // a texel of level L spans 2^L texels of level 0, placed anywhere; it stays
+  // inside an entry and its gutter while 2^L <= padding
+  int atlas_levels() const {
+    int levels = 1;
+    while ((2 << (levels - 1)) <= padding && levels < texture_levels(atlas_size, atlas_size))
+      levels++;
+    return levels;
+  }
+
+  // replicate the border texels into the gutter so bilinear filtering and the
+  // mips atlas_levels() keeps don't bleed neighbouring atlas entries in
+  std::vector<unsigned char> pad(const Image &image) const {
+    int w = image.width + 2 * padding, h = image.height + 2 * padding, c = image.channels;
+    std::vector<unsigned char> out((size_t)w * h * c);
+    for (int y = 0; y < h; y++) {
+      int sy = std::min(std::max(y - padding, 0), image.height - 1);
+      for (int x = 0; x < w; x++) {
+        int sx = std::min(std::max(x - padding, 0), image.width - 1);
+        memcpy(&out[((size_t)y * w + x) * c], &image.pixels[((size_t)sy * image.width + sx) * c], c);
+      }
+    }
+    return out;
+  }
+};
+
+#endif // TEXTURE_PACKING_H
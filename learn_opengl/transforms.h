@@ -0,0 +1,137 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "compact_instance.h"
+#include "entity_store.h"
+#include "frame_arena.h"
+#include "job_system.h"
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// instances per job; big enough that a job is a few tens of microseconds of
+// work, small enough to balance across cores
+const size_t TRANSFORM_GRAIN = 4096;
+
+// world matrix of every instance, translate(position) * rotate(angle + spin,
+// axis), written straight to `out` (typically a mapped instance buffer, so
+// every element is written exactly once and never read back)
+inline void update_transforms(JobSystem &jobs, const glm::vec3 *positions, const float *angles, float spin,
+                              const glm::vec3 &axis, size_t count, glm::mat4 *out) {
+  jobs.parallel_for(count, TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+      out[i] = glm::rotate(model, angles[i] + spin, axis);
+    }
+  });
+}
+
+// turn every entity by `rotation` (a unit quaternion) in its local frame,
+// renormalizing so rounding doesn't accumulate
+inline void spin_entities(JobSystem &jobs, EntityStore &store, const glm::vec4 &rotation) {
+  jobs.parallel_for(store.size(), TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+    float *qx = store.rotation_x.data(), *qy = store.rotation_y.data();
+    float *qz = store.rotation_z.data(), *qw = store.rotation_w.data();
+    float x2 = rotation.x, y2 = rotation.y, z2 = rotation.z, w2 = rotation.w;
+    for (size_t i = begin; i < end; i++) {
+      float x1 = qx[i], y1 = qy[i], z1 = qz[i], w1 = qw[i];
+      float x = w1 * x2 + x1 * w2 + y1 * z2 - z1 * y2;
+      float y = w1 * y2 - x1 * z2 + y1 * w2 + z1 * x2;
+      float z = w1 * z2 + x1 * y2 - y1 * x2 + z1 * w2;
+      float w = w1 * w2 - x1 * x2 - y1 * y2 - z1 * z2;
+      float norm = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+      qx[i] = x * norm;
+      qy[i] = y * norm;
+      qz[i] = z * norm;
+      qw[i] = w * norm;
+    }
+  });
+}
+
+// the entities as they are `alpha` of the way from `previous` to `current`,
+// two simulation states of the same entities, for rendering between ticks:
+// positions and scales are blended linearly, rotations along the shorter arc
+// and renormalized (nlerp, close enough to slerp for a tick's turn). `out`
+// gets everything else from `current`
+inline void interpolate_entities(JobSystem &jobs, const EntityStore &previous, const EntityStore &current, float alpha,
+                                 EntityStore &out) {
+  if (out.size() != current.size() || previous.size() != current.size()) {
+    out = current;
+    return;
+  }
+  out.radius = current.radius;
+  out.material = current.material;
+  jobs.parallel_for(current.size(), TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+    auto blend = [&](const std::vector<float> &a, const std::vector<float> &b, std::vector<float> &result) {
+      for (size_t i = begin; i < end; i++)
+        result[i] = a[i] + (b[i] - a[i]) * alpha;
+    };
+    blend(previous.position_x, current.position_x, out.position_x);
+    blend(previous.position_y, current.position_y, out.position_y);
+    blend(previous.position_z, current.position_z, out.position_z);
+    blend(previous.scale, current.scale, out.scale);
+    for (size_t i = begin; i < end; i++) {
+      float x1 = previous.rotation_x[i], y1 = previous.rotation_y[i];
+      float z1 = previous.rotation_z[i], w1 = previous.rotation_w[i];
+      float x2 = current.rotation_x[i], y2 = current.rotation_y[i];
+      float z2 = current.rotation_z[i], w2 = current.rotation_w[i];
+      float sign = x1 * x2 + y1 * y2 + z1 * z2 + w1 * w2 < 0.0f ? -1.0f : 1.0f; // q and -q are the same turn
+      float x = x1 + (sign * x2 - x1) * alpha, y = y1 + (sign * y2 - y1) * alpha;
+      float z = z1 + (sign * z2 - z1) * alpha, w = w1 + (sign * w2 - w1) * alpha;
+      float norm = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+      out.rotation_x[i] = x * norm;
+      out.rotation_y[i] = y * norm;
+      out.rotation_z[i] = z * norm;
+      out.rotation_w[i] = w * norm;
+    }
+  });
+}
+
+// `encode(store, i)` of the visible entities with `material`, packed from
+// out[0] in entity order; returns how many were written
+//
+// Each job first counts its matches, a prefix sum over the jobs gives every
+// job its output offset, then all of them write in parallel.
+template <typename Instance, typename Encode>
+size_t write_visible_instances(JobSystem &jobs, const EntityStore &store, uint32_t material, Instance *out,
+                               const Encode &encode) {
+  size_t count = store.size(), chunks = (count + TRANSFORM_GRAIN - 1) / TRANSFORM_GRAIN;
+  FrameVector<size_t> offsets(chunks + 1, 0);
+  auto matches = [&](size_t i) { return store.material[i] == material && store.is_visible(i); };
+  jobs.parallel_for(count, TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+    size_t found = 0;
+    for (size_t i = begin; i < end; i++)
+      found += matches(i);
+    offsets[begin / TRANSFORM_GRAIN + 1] = found;
+  });
+  for (size_t chunk = 0; chunk < chunks; chunk++)
+    offsets[chunk + 1] += offsets[chunk];
+
+  jobs.parallel_for(count, TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+    Instance *target = out + offsets[begin / TRANSFORM_GRAIN];
+    for (size_t i = begin; i < end; i++)
+      if (matches(i))
+        *target++ = encode(store, i);
+  });
+  return offsets[chunks];
+}
+
+// world matrices of the visible entities with `material`
+inline size_t write_visible_transforms(JobSystem &jobs, const EntityStore &store, uint32_t material,
+                                       glm::mat4 *out) {
+  return write_visible_instances(jobs, store, material, out,
+                                 [](const EntityStore &store, size_t i) { return store.matrix(i); });
+}
+
+// compact instances of the visible entities with `material`, 24 bytes each
+// instead of 64
+inline size_t write_visible_compact(JobSystem &jobs, const EntityStore &store, uint32_t material,
+                                    CompactInstance *out) {
+  return write_visible_instances(jobs, store, material, out, compact_instance);
+}
+
+#endif // TRANSFORMS_H
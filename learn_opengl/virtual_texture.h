@@ -0,0 +1,520 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include "glad/glad.h"
+
+#include "gl_extensions.h"
+#include "mapped_file.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// paged virtual texture container (.cgvt)
+//
+//   VirtualTextureHeader
+//   uint64_t page_offsets[]   every page of every level, level 0 first, rows
+//                             top to bottom
+//   page data                 (tile_size + 2 * border)^2 RGBA8 texels each
+//
+// Each page carries a `border` texel apron copied from its neighbours (clamped
+// at the level edges) so bilinear filtering inside the physical cache never
+// reads another page.
+// ------------------------------------------------------------------------
+static const char VIRTUAL_TEXTURE_MAGIC[4] = {'C', 'G', 'V', 'T'};
+static const uint32_t VIRTUAL_TEXTURE_VERSION = 1;
+
+struct VirtualTextureHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t tile_size;
+  uint32_t border;
+  uint32_t levels;
+  uint32_t reserved;
+};
+
+inline int virtual_level_size(int size, int level) { return (size >> level) > 1 ? (size >> level) : 1; }
+
+inline int virtual_level_pages(int size, int level, int tile_size) {
+  return (virtual_level_size(size, level) + tile_size - 1) / tile_size;
+}
+
+// levels stop at the first one that fits in a single page
+inline int virtual_texture_levels(int width, int height, int tile_size) {
+  int levels = 1;
+  while (virtual_level_pages(width, levels - 1, tile_size) > 1 || virtual_level_pages(height, levels - 1, tile_size) > 1)
+    levels++;
+  return levels;
+}
+
+// bake an RGBA image into pages. Only the current and next mip level are kept
+// in memory while writing.
+inline bool write_virtual_texture(const char *path, const Image &image, int tile_size = 128, int border = 1) {
+  if (image.channels != 4) {
+    std::cout << "ERROR::VIRTUAL_TEXTURE::NEEDS_RGBA: " << path << std::endl;
+    return false;
+  }
+
+  VirtualTextureHeader header;
+  memcpy(header.magic, VIRTUAL_TEXTURE_MAGIC, 4);
+  header.version = VIRTUAL_TEXTURE_VERSION;
+  header.width = (uint32_t)image.width;
+  header.height = (uint32_t)image.height;
+  header.tile_size = (uint32_t)tile_size;
+  header.border = (uint32_t)border;
+  header.levels = (uint32_t)virtual_texture_levels(image.width, image.height, tile_size);
+  header.reserved = 0;
+
+  size_t page_count = 0;
+  for (int level = 0; level < (int)header.levels; level++)
+    page_count += (size_t)virtual_level_pages(image.width, level, tile_size) *
+                  virtual_level_pages(image.height, level, tile_size);
+
+  int slot = tile_size + 2 * border;
+  size_t page_bytes = (size_t)slot * slot * 4;
+  std::vector<uint64_t> offsets(page_count);
+  uint64_t offset = sizeof(VirtualTextureHeader) + sizeof(uint64_t) * page_count;
+  for (size_t i = 0; i < page_count; i++, offset += page_bytes)
+    offsets[i] = offset;
+
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    std::cout << "ERROR::VIRTUAL_TEXTURE::OPEN_FAILED: " << path << std::endl;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size();
+
+  std::vector<unsigned char> page(page_bytes);
+  Image mip = image;
+  for (int level = 0; ok && level < (int)header.levels; level++) {
+    if (level > 0)
+      mip = downsample_image(mip);
+    int pages_x = virtual_level_pages(image.width, level, tile_size);
+    int pages_y = virtual_level_pages(image.height, level, tile_size);
+    for (int py = 0; ok && py < pages_y; py++) {
+      for (int px = 0; ok && px < pages_x; px++) {
+        for (int y = 0; y < slot; y++) {
+          int sy = py * tile_size + y - border;
+          sy = sy < 0 ? 0 : (sy >= mip.height ? mip.height - 1 : sy);
+          for (int x = 0; x < slot; x++) {
+            int sx = px * tile_size + x - border;
+            sx = sx < 0 ? 0 : (sx >= mip.width ? mip.width - 1 : sx);
+            memcpy(&page[((size_t)y * slot + x) * 4], &mip.pixels[((size_t)sy * mip.width + sx) * 4], 4);
+          }
+        }
+        ok = fwrite(page.data(), 1, page.size(), out) == page.size();
+      }
+    }
+  }
+  ok = fclose(out) == 0 && ok;
+  if (!ok)
+    std::cout << "ERROR::VIRTUAL_TEXTURE::WRITE_FAILED: " << path << std::endl;
+  return ok;
+}
+
+// a texture far larger than GPU memory, streamed page by page:
+//
+// - the scene is drawn once into a small integer feedback target (see
+//   3.8.vt_feedback.fs) where every pixel names the page it wants
+// - update() reads that target back through a ring of pixel pack buffers a
+//   frame late, so it never stalls, and streams missing pages from the mapped
+//   file into free slots of the physical cache, evicting the least recently
+//   requested ones
+// - the page table, one layer per mip level, maps every page to the cache
+//   slot of itself or of its closest resident ancestor, and is sampled by
+//   3.8.vt.fs to translate virtual into physical coordinates
+//
+// The page table is maintained in software, which works everywhere including
+// llvmpipe. `sparse_supported` only reports ARB_sparse_texture for now: its
+// entry points are not part of the thirdparty glad loader.
+class VirtualTexture {
+public:
+  int width;
+  int height;
+  int tile_size;
+  int border;
+  int levels;
+  bool sparse_supported;
+
+  // filled by update()
+  struct Stats {
+    int requested; // distinct pages in the last feedback
+    int resident;
+    int uploads;
+    int evictions;
+  } stats;
+
+  VirtualTexture()
+      : width(0), height(0), tile_size(0), border(0), levels(0), sparse_supported(false), stats(), file(NULL),
+        cache_side(0), cache_texture(0), page_table_texture(0), feedback_fbo(0), feedback_color(0),
+        feedback_depth(0), feedback_width(0), feedback_height(0), feedback_frame(0), previous_framebuffer(0),
+        page_table_dirty(false) {
+    feedback_pbo[0] = feedback_pbo[1] = 0;
+    feedback_pending[0] = feedback_pending[1] = false;
+  }
+
+  ~VirtualTexture() { delete file; }
+
+  VirtualTexture(const VirtualTexture &) = delete;
+  VirtualTexture &operator=(const VirtualTexture &) = delete;
+
+  // map `path` and allocate a physical cache of slots_per_side^2 pages
+  bool open(const char *path, int slots_per_side = 16) {
+    file = new MappedFile(path);
+    if (!file->is_open())
+      return false;
+    if (file->size < sizeof(VirtualTextureHeader)) {
+      std::cout << "ERROR::VIRTUAL_TEXTURE::TRUNCATED: " << path << std::endl;
+      return false;
+    }
+    VirtualTextureHeader header;
+    memcpy(&header, file->data, sizeof(header));
+    if (memcmp(header.magic, VIRTUAL_TEXTURE_MAGIC, 4) != 0 || header.version != VIRTUAL_TEXTURE_VERSION ||
+        header.tile_size == 0 || header.levels == 0 ||
+        (int)header.levels != virtual_texture_levels(header.width, header.height, header.tile_size)) {
+      std::cout << "ERROR::VIRTUAL_TEXTURE::BAD_HEADER: " << path << std::endl;
+      return false;
+    }
+    width = (int)header.width;
+    height = (int)header.height;
+    tile_size = (int)header.tile_size;
+    border = (int)header.border;
+    levels = (int)header.levels;
+
+    // per level page counts and where each level starts in the offset table
+    size_t page_count = 0;
+    for (int level = 0; level < levels; level++) {
+      level_first_page.push_back(page_count);
+      page_count += (size_t)pages_x(level) * pages_y(level);
+    }
+    if (file->size < sizeof(VirtualTextureHeader) + sizeof(uint64_t) * page_count) {
+      std::cout << "ERROR::VIRTUAL_TEXTURE::TRUNCATED: " << path << std::endl;
+      return false;
+    }
+    page_offsets.resize(page_count);
+    memcpy(page_offsets.data(), file->data + sizeof(VirtualTextureHeader), sizeof(uint64_t) * page_count);
+    for (uint64_t offset : page_offsets) {
+      if (offset + page_bytes() > file->size) {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::TRUNCATED: " << path << std::endl;
+        return false;
+      }
+    }
+
+    sparse_supported = has_gl_extension("GL_ARB_sparse_texture");
+
+    // physical cache, slots are filled with glTexSubImage2D as pages stream in
+    cache_side = slots_per_side;
+    glGenTextures(1, &cache_texture);
+    glBindTexture(GL_TEXTURE_2D, cache_texture);
+    allocate_texture_storage(GL_TEXTURE_2D, 1, GL_RGBA8, cache_side * slot_size(), cache_side * slot_size());
+    gpu_memory().track_texture(cache_texture, GL_RGBA8, cache_side * slot_size(), cache_side * slot_size(), 1, 1,
+                               "virtual texture");
+    for (int i = cache_side * cache_side - 1; i >= 0; i--)
+      free_slots.push_back(i);
+
+    // page table, layer = mip level, each texel = (slot x, slot y, mapped level)
+    glGenTextures(1, &page_table_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, page_table_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8UI, pages_x(0), pages_y(0), levels, 0, GL_RGBA_INTEGER,
+                 GL_UNSIGNED_BYTE, NULL);
+    gpu_memory().track_texture(page_table_texture, GL_RGBA8UI, pages_x(0), pages_y(0), levels, 1, "virtual texture");
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    page_table.assign((size_t)pages_x(0) * pages_y(0) * levels * 4, 0);
+
+    // the coarsest level is a single page, pin it so every lookup has a fallback
+    make_resident(page_key(levels - 1, 0, 0), true);
+    rebuild_page_table();
+    return true;
+  }
+
+  int slot_size() const { return tile_size + 2 * border; }
+  int cache_size() const { return cache_side * slot_size(); }
+
+  // bind the physical cache and the page table to the given texture units
+  void bind(unsigned int cache_unit, unsigned int page_table_unit) const {
+    glActiveTexture(GL_TEXTURE0 + cache_unit);
+    glBindTexture(GL_TEXTURE_2D, cache_texture);
+    glActiveTexture(GL_TEXTURE0 + page_table_unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, page_table_texture);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // render into the feedback target until end_feedback(), draw with the
+  // feedback shader. The target is (re)allocated when the size changes.
+  void begin_feedback(int target_width, int target_height) {
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer);
+    if (target_width != feedback_width || target_height != feedback_height)
+      create_feedback_target(target_width, target_height);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+    glViewport(0, 0, feedback_width, feedback_height);
+    GLuint none[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, none);
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+
+  // queue the asynchronous readback of this frame's requests
+  void end_feedback() {
+    int index = feedback_frame % 2;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbo[index]);
+    glReadPixels(0, 0, feedback_width, feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback_pending[index] = true;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+  }
+
+  // consume the feedback from the previous frame and stream in at most
+  // `max_uploads` missing pages
+  void update(int max_uploads = 8) {
+    feedback_frame++;
+    stats.uploads = 0;
+    stats.evictions = 0;
+
+    int index = feedback_frame % 2;
+    if (!feedback_pending[index]) {
+      stats.resident = (int)resident.size();
+      return;
+    }
+    feedback_pending[index] = false;
+
+    std::unordered_set<uint64_t> requested;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbo[index]);
+    const uint16_t *texels = (const uint16_t *)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)feedback_width * feedback_height * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+    if (texels) {
+      for (int i = 0; i < feedback_width * feedback_height; i++) {
+        const uint16_t *request = texels + i * 4;
+        if (request[3] == 0 || request[2] >= levels)
+          continue;
+        int level = request[2];
+        if (request[0] >= pages_x(level) || request[1] >= pages_y(level))
+          continue;
+        requested.insert(page_key(level, request[0], request[1]));
+      }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    stats.requested = (int)requested.size();
+
+    // refresh recency of everything still wanted, collect what is missing
+    std::vector<uint64_t> missing;
+    for (uint64_t key : requested) {
+      auto it = resident.find(key);
+      if (it != resident.end())
+        lru.splice(lru.begin(), lru, it->second.lru);
+      else
+        missing.push_back(key);
+    }
+
+    // coarse pages first, they cover the most screen area as a fallback
+    std::sort(missing.begin(), missing.end(), [](uint64_t a, uint64_t b) { return (a >> 48) > (b >> 48); });
+    for (uint64_t key : missing) {
+      if (stats.uploads >= max_uploads)
+        break;
+      if (!make_resident(key, false))
+        break;
+      stats.uploads++;
+    }
+
+    if (page_table_dirty)
+      rebuild_page_table();
+    stats.resident = (int)resident.size();
+  }
+
+  // needs the GL context, so call it before glfwTerminate
+  void destroy() {
+    release_feedback_memory();
+    gpu_memory().release(GPU_TEXTURE, cache_texture);
+    gpu_memory().release(GPU_TEXTURE, page_table_texture);
+    glDeleteTextures(1, &cache_texture);
+    glDeleteTextures(1, &page_table_texture);
+    glDeleteFramebuffers(1, &feedback_fbo);
+    glDeleteTextures(1, &feedback_color);
+    glDeleteRenderbuffers(1, &feedback_depth);
+    glDeleteBuffers(2, feedback_pbo);
+    cache_texture = page_table_texture = feedback_fbo = feedback_color = feedback_depth = 0;
+    feedback_pbo[0] = feedback_pbo[1] = 0;
+    feedback_width = feedback_height = 0;
+  }
+
+private:
+  struct Residency {
+    int slot;
+    bool pinned;
+    std::list<uint64_t>::iterator lru;
+  };
+
+  MappedFile *file;
+  std::vector<size_t> level_first_page;
+  std::vector<uint64_t> page_offsets;
+
+  int cache_side;
+  unsigned int cache_texture;
+  std::vector<int> free_slots;
+  std::unordered_map<uint64_t, Residency> resident;
+  std::list<uint64_t> lru; // most recently requested first
+
+  unsigned int page_table_texture;
+  std::vector<unsigned char> page_table; // CPU copy of every layer
+
+  unsigned int feedback_fbo;
+  unsigned int feedback_color;
+  unsigned int feedback_depth;
+  unsigned int feedback_pbo[2];
+  bool feedback_pending[2];
+  int feedback_width;
+  int feedback_height;
+  unsigned int feedback_frame;
+  GLint previous_framebuffer; // restored by end_feedback()
+
+  bool page_table_dirty;
+
+  int pages_x(int level) const { return virtual_level_pages(width, level, tile_size); }
+  int pages_y(int level) const { return virtual_level_pages(height, level, tile_size); }
+  size_t page_bytes() const { return (size_t)slot_size() * slot_size() * 4; }
+
+  static uint64_t page_key(int level, int x, int y) {
+    return ((uint64_t)level << 48) | ((uint64_t)(uint32_t)y << 24) | (uint64_t)(uint32_t)x;
+  }
+  static int key_level(uint64_t key) { return (int)(key >> 48); }
+  static int key_y(uint64_t key) { return (int)((key >> 24) & 0xffffff); }
+  static int key_x(uint64_t key) { return (int)(key & 0xffffff); }
+
+  bool make_resident(uint64_t key, bool pinned) {
+    int slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      // least recently requested, unpinned page gives up its slot
+      auto victim = lru.end();
+      while (victim != lru.begin()) {
+        --victim;
+        if (!resident[*victim].pinned)
+          break;
+      }
+      if (victim == lru.end() || resident[*victim].pinned)
+        return false;
+      slot = resident[*victim].slot;
+      resident.erase(*victim);
+      lru.erase(victim);
+      stats.evictions++;
+    }
+
+    int level = key_level(key), x = key_x(key), y = key_y(key);
+    const unsigned char *pixels = file->data + page_offsets[level_first_page[level] + (size_t)y * pages_x(level) + x];
+    // leave whatever the caller has on the active unit alone
+    GLint bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glBindTexture(GL_TEXTURE_2D, cache_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cache_side) * slot_size(), (slot / cache_side) * slot_size(),
+                    slot_size(), slot_size(), GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    lru.push_front(key);
+    resident[key] = {slot, pinned, lru.begin()};
+    page_table_dirty = true;
+    return true;
+  }
+
+  // every page points at itself when resident, otherwise at the entry of its
+  // parent, which was filled in first since levels are walked coarse to fine
+  void rebuild_page_table() {
+    size_t layer_texels = (size_t)pages_x(0) * pages_y(0);
+    for (int level = levels - 1; level >= 0; level--) {
+      unsigned char *layer = &page_table[layer_texels * level * 4];
+      unsigned char *parent = level + 1 < levels ? &page_table[layer_texels * (level + 1) * 4] : NULL;
+      for (int y = 0; y < pages_y(level); y++) {
+        for (int x = 0; x < pages_x(level); x++) {
+          unsigned char *entry = &layer[((size_t)y * pages_x(0) + x) * 4];
+          auto it = resident.find(page_key(level, x, y));
+          if (it != resident.end()) {
+            entry[0] = (unsigned char)(it->second.slot % cache_side);
+            entry[1] = (unsigned char)(it->second.slot / cache_side);
+            entry[2] = (unsigned char)level;
+            entry[3] = 1;
+          } else if (parent) {
+            memcpy(entry, &parent[((size_t)(y / 2) * pages_x(0) + x / 2) * 4], 4);
+          }
+        }
+      }
+    }
+
+    GLint bound, unpack_alignment;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, page_table_texture);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, pages_x(0), pages_y(0), levels, GL_RGBA_INTEGER,
+                    GL_UNSIGNED_BYTE, page_table.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bound);
+    page_table_dirty = false;
+  }
+
+  void create_feedback_target(int target_width, int target_height) {
+    if (feedback_fbo) {
+      release_feedback_memory();
+      glDeleteFramebuffers(1, &feedback_fbo);
+      glDeleteTextures(1, &feedback_color);
+      glDeleteRenderbuffers(1, &feedback_depth);
+      glDeleteBuffers(2, feedback_pbo);
+    }
+    feedback_width = target_width;
+    feedback_height = target_height;
+    feedback_pending[0] = feedback_pending[1] = false;
+
+    GLint bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glGenTextures(1, &feedback_color);
+    glBindTexture(GL_TEXTURE_2D, feedback_color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, feedback_width, feedback_height, 0, GL_RGBA_INTEGER,
+                 GL_UNSIGNED_SHORT, NULL);
+    gpu_memory().track_texture(feedback_color, GL_RGBA16UI, feedback_width, feedback_height, 1, 1, "virtual texture");
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    glGenRenderbuffers(1, &feedback_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedback_width, feedback_height);
+    gpu_memory().track_renderbuffer(feedback_depth, GL_DEPTH_COMPONENT24, feedback_width, feedback_height,
+                                    "virtual texture");
+
+    glGenFramebuffers(1, &feedback_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cout << "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+
+    glGenBuffers(2, feedback_pbo);
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbo[i]);
+      tracked_buffer_data(GL_PIXEL_PACK_BUFFER, feedback_pbo[i],
+                          (GLsizeiptr)feedback_width * feedback_height * 4 * sizeof(uint16_t), NULL, GL_STREAM_READ,
+                          "virtual texture");
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  void release_feedback_memory() {
+    gpu_memory().release(GPU_TEXTURE, feedback_color);
+    gpu_memory().release(GPU_RENDERBUFFER, feedback_depth);
+    gpu_memory().release(GPU_BUFFER, feedback_pbo[0]);
+    gpu_memory().release(GPU_BUFFER, feedback_pbo[1]);
+  }
+};
+
+#endif // VIRTUAL_TEXTURE_H
@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+"""Cut the generated glad loader down to the GL profile the demos use.
+
+The glad 0.1 loader in src/glad.c resolves all ~1100 entry points of the GL
+4.6 compatibility profile at gladLoadGLLoader() time. This writes a glad.c
+for the same include/glad/glad.h that
+
+- keeps the core profile entry points up to --api (gl_core_profile.txt).
+  The ones the sources under --scan call are resolved at load time. The
+  rarely used rest is resolved lazily: gladLoadGLLoader() points it at a
+  trampoline that looks the function up on the first call and replaces
+  itself, so new code can call any of them without regenerating,
+- resolves the entry points of the --extensions at load time, and only when
+  the context has them (core version or extension string), so
+  `glTexStorage2D != NULL` keeps meaning "supported",
+- leaves everything else out. Calling an entry point outside the profile is
+  a link error (undefined glad_glFoo) instead of a NULL call at run time.
+
+    trim_glad.py --api 3.3 --extensions GL_KHR_debug,GL_ARB_buffer_storage --scan learn_opengl --out glad.c
+"""
+
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# the extensions the loader knows, with the GL version they became core in
+# and their entry points; all are "core extensions", whose entry points have
+# no suffix, so the functions glad.h declares for that version serve both
+EXTENSIONS = {
+    "GL_ARB_timer_query": ((3, 3), ["glQueryCounter", "glGetQueryObjecti64v", "glGetQueryObjectui64v"]),
+    "GL_ARB_draw_indirect": ((4, 0), ["glDrawArraysIndirect", "glDrawElementsIndirect"]),
+    "GL_ARB_texture_storage": ((4, 2), ["glTexStorage1D", "glTexStorage2D", "glTexStorage3D"]),
+    "GL_KHR_debug": ((4, 3), ["glDebugMessageControl", "glDebugMessageInsert", "glDebugMessageCallback",
+                              "glGetDebugMessageLog", "glPushDebugGroup", "glPopDebugGroup", "glObjectLabel",
+                              "glGetObjectLabel", "glObjectPtrLabel", "glGetObjectPtrLabel"]),
+    "GL_ARB_multi_draw_indirect": ((4, 3), ["glMultiDrawArraysIndirect", "glMultiDrawElementsIndirect"]),
+    "GL_ARB_buffer_storage": ((4, 4), ["glBufferStorage"]),
+}
+
+SOURCE_SUFFIXES = (".h", ".hpp", ".c", ".cc", ".cpp")
+
+
+def fail(message):
+    sys.exit("trim_glad.py: " + message)
+
+
+def read(path):
+    with open(path) as f:
+        return f.read()
+
+
+def parse_profile(path, api):
+    """(entry point, version) of the core profile up to `api`, in file order"""
+    functions, version = [], None
+    for line in read(path).splitlines():
+        line = line.strip()
+        if not line or line.startswith("#"):
+            continue
+        match = re.match(r"\[GL_VERSION_(\d)_(\d)\]$", line)
+        if match:
+            version = (int(match.group(1)), int(match.group(2)))
+        elif version is None:
+            fail("%s: entry point %s before any version" % (path, line))
+        elif version <= api:
+            functions.append((line, version))
+    return functions
+
+
+def parse_prototypes(header):
+    """function name -> (return type, parameter list) from glad.h"""
+    prototypes = {}
+    for ret, name, params in re.findall(r"^typedef (.+?) \(APIENTRYP PFN(GL\w+)PROC\)\((.*)\);$", header, re.M):
+        prototypes[name] = (ret.strip(), params.strip())
+    functions = {}
+    for function in re.findall(r"^#define (gl[A-Z]\w*) glad_\1$", header, re.M):
+        key = function.upper()
+        if key not in prototypes:
+            fail("glad.h has no prototype for " + function)
+        functions[function] = prototypes[key]
+    return functions
+
+
+def scan_calls(directories):
+    """every glFoo( in the sources below `directories`"""
+    called = set()
+    for directory in directories:
+        for root, _, files in os.walk(directory):
+            for name in files:
+                if name.endswith(SOURCE_SUFFIXES):
+                    called.update(re.findall(r"\b(gl[A-Z]\w*)\s*\(", read(os.path.join(root, name))))
+    return called
+
+
+def argument_names(params):
+    if params in ("", "void"):
+        return []
+    names = []
+    for param in params.split(","):
+        match = re.search(r"(\w+)\s*$", param)
+        if not match:
+            fail("can't name the parameter '%s'" % param)
+        names.append(match.group(1))
+    return names
+
+
+def section(source, start, end):
+    begin = source.find(start)
+    stop = source.find(end, begin)
+    if begin < 0 or stop < 0:
+        fail("src/glad.c doesn't look like a glad 0.1 loader (no '%s')" % start.strip())
+    return source[begin:stop]
+
+
+def load_line(function):
+    return "\tglad_%s = (PFN%sPROC)load(\"%s\");\n" % (function, function.upper(), function)
+
+
+def generate(glad_c, glad_h, profile, api, extensions, called, command_line):
+    prototypes = parse_prototypes(glad_h)
+    core = parse_profile(profile, api)
+    for function, _ in core:
+        if function not in prototypes:
+            fail("glad.h doesn't declare " + function)
+    core_set = set(function for function, _ in core)
+    eager = [(function, version) for function, version in core if function in called]
+    lazy = [function for function, _ in core if function not in called]
+
+    # the platform loader, GLVersion and the extension string helpers stay as
+    # they are; gladLoadGL() keeps libGL open, the trampolines need it later
+    prologue = section(glad_c, "#include <stdio.h>", "int GLAD_GL_VERSION_1_0")
+    closing = "status = gladLoadGLLoader(&get_proc);\n        close_gl();"
+    if closing not in prologue:
+        fail("src/glad.c: gladLoadGL() not found")
+    prologue = prologue.replace(closing, "status = gladLoadGLLoader(&get_proc);\n        if(!status) close_gl();")
+    versions = re.findall(r"^int GLAD_GL_VERSION_\d_\d = 0;$", glad_c, re.M)
+    find_core = section(glad_c, "static void find_coreGL(void) {", "int gladLoadGLLoader")
+
+    out = []
+    out.append("""/*
+
+    OpenGL loader trimmed from the glad 0.1.36 loader in thirdparty/glad by
+    trim_glad.py, do not edit.
+
+    API: gl=%d.%d core, %d entry points loaded, %d resolved on their first call
+    Extensions: %s
+
+    Commandline:
+        %s
+*/
+
+""" % (api[0], api[1], len(eager), len(lazy), ", ".join(extensions) or "none", command_line))
+    out.append(prologue)
+    out.extend(line + "\n" for line in versions)
+
+    # entry points the sources call, loaded up front like glad does
+    for function, _ in eager:
+        out.append("PFN%sPROC glad_%s = NULL;\n" % (function.upper(), function))
+    loaded_versions = sorted(set(version for _, version in eager))
+    for version in loaded_versions:
+        out.append("static void load_GL_VERSION_%d_%d(GLADloadproc load) {\n" % version)
+        out.append("\tif(!GLAD_GL_VERSION_%d_%d) return;\n" % version)
+        out.extend(load_line(function) for function, v in eager if v == version)
+        out.append("}\n")
+
+    # the rarely used rest
+    out.append("""
+static GLADloadproc glad_lazy_load = NULL;
+
+/* Called by the trampolines on a thread whose context is current, as every
+ * GL call is. Two threads may race to resolve the same entry point; both
+ * store the same pointer. Kept out of line, the trampolines stay a call. */
+#if defined(__GNUC__)
+__attribute__((noinline))
+#elif defined(_MSC_VER)
+__declspec(noinline)
+#endif
+static void* glad_lazy_resolve(const char *name) {
+    void *proc = glad_lazy_load != NULL ? glad_lazy_load(name) : NULL;
+    if(proc == NULL) {
+        fprintf(stderr, "glad: %s is not available in this context\\n", name);
+        abort();
+    }
+    return proc;
+}
+""")
+    for function in lazy:
+        ret, params = prototypes[function]
+        call = "glad_%s(%s);" % (function, ", ".join(argument_names(params)))
+        out.append("static %s APIENTRY glad_lazy_%s(%s) {\n" % (ret, function, params or "void"))
+        out.append("\tglad_%s = (PFN%sPROC)glad_lazy_resolve(\"%s\");\n" % (function, function.upper(), function))
+        out.append("\t%s%s\n}\n" % ("" if ret == "void" else "return ", call))
+        out.append("PFN%sPROC glad_%s = NULL;\n" % (function.upper(), function))
+    # assigned in code rather than initialised: a pointer to a function is a
+    # relocation per entry point in a position independent executable
+    out.append("static void reset_lazy(void) {\n")
+    for function in lazy:
+        out.append("\tglad_%s = glad_lazy_%s;\n" % (function, function))
+    out.append("}\n")
+
+    loaders, defined = [], set()
+    for extension in extensions:
+        if extension not in EXTENSIONS:
+            fail("unknown extension %s, known are %s" % (extension, ", ".join(sorted(EXTENSIONS))))
+        (major, minor), functions = EXTENSIONS[extension]
+        functions = [f for f in functions if f not in core_set and f not in defined]
+        if not functions:
+            continue  # core in --api
+        for function in functions:
+            if function not in prototypes:
+                fail("glad.h doesn't declare " + function)
+            out.append("PFN%sPROC glad_%s = NULL;\n" % (function.upper(), function))
+            defined.add(function)
+        out.append("static void load_%s(GLADloadproc load) {\n" % extension)
+        out.append("\tif(!GLAD_GL_VERSION_%d_%d && !has_ext(\"%s\")) return;\n" % (major, minor, extension))
+        out.extend(load_line(function) for function in functions)
+        out.append("}\n")
+        loaders.append((extension, (major, minor)))
+
+    out.append("static int find_extensionsGL(GLADloadproc load) {\n")
+    if loaders:
+        newest = max(version for _, version in loaders)
+        out.append("\t/* the extension strings are only read when some extension isn't core */\n")
+        out.append("\tif(!GLAD_GL_VERSION_%d_%d && !get_exts()) return 0;\n" % newest)
+        out.extend("\tload_%s(load);\n" % extension for extension, _ in loaders)
+        out.append("\tfree_exts();\n")
+    out.append("\t(void)&has_ext;\n\t(void)&get_exts;\n\t(void)&free_exts;\n\t(void)load;\n\treturn 1;\n}\n\n")
+
+    out.append(find_core)
+    out.append("int gladLoadGLLoader(GLADloadproc load) {\n")
+    out.append("\tGLVersion.major = 0; GLVersion.minor = 0;\n")
+    out.append("\tglad_lazy_load = load;\n\treset_lazy();\n")
+    out.append("\tglGetString = (PFNGLGETSTRINGPROC)load(\"glGetString\");\n")
+    out.append("\tif(glGetString == NULL) return 0;\n\tif(glGetString(GL_VERSION) == NULL) return 0;\n")
+    out.append("\tfind_coreGL();\n")
+    out.extend("\tload_GL_VERSION_%d_%d(load);\n" % version for version in loaded_versions)
+    out.append("\n\tif (!find_extensionsGL(load)) return 0;\n")
+    out.append("\treturn GLVersion.major != 0 || GLVersion.minor != 0;\n}\n")
+    return "".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--api", default="3.3", help="core profile version to keep, e.g. 3.3")
+    parser.add_argument("--extensions", default="", help="comma separated, e.g. GL_KHR_debug,GL_ARB_buffer_storage")
+    parser.add_argument("--scan", action="append", default=[],
+                        help="source directory whose gl* calls are loaded up front, may repeat")
+    parser.add_argument("--glad-dir", default=HERE, help="directory with src/glad.c and include/glad/glad.h")
+    parser.add_argument("--profile", default=os.path.join(HERE, "gl_core_profile.txt"))
+    parser.add_argument("--out", required=True)
+    args = parser.parse_args()
+
+    match = re.match(r"^(\d)\.(\d)$", args.api)
+    if not match:
+        fail("--api wants MAJOR.MINOR, got " + args.api)
+    api = (int(match.group(1)), int(match.group(2)))
+    extensions = [e.strip() for e in args.extensions.split(",") if e.strip()]
+    command_line = " ".join(["trim_glad.py", "--api", args.api] +
+                            (["--extensions", ",".join(extensions)] if extensions else []) +
+                            ["--scan " + os.path.basename(os.path.normpath(d)) for d in args.scan])
+
+    source = generate(read(os.path.join(args.glad_dir, "src", "glad.c")),
+                      read(os.path.join(args.glad_dir, "include", "glad", "glad.h")), args.profile, api, extensions,
+                      scan_calls(args.scan), command_line)
+
+    # several targets may run this at once, the file only appears complete
+    directory = os.path.dirname(os.path.abspath(args.out))
+    os.makedirs(directory, exist_ok=True)
+    temporary = "%s.%d.tmp" % (args.out, os.getpid())
+    with open(temporary, "w") as f:
+        f.write(source)
+    os.replace(temporary, args.out)
+
+
+if __name__ == "__main__":
+    main()